@@ -0,0 +1,29 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <stdint.h>
+
+// Retry delays that double after every failure, from baseMs up to maxMs,
+// with "equal jitter": each delay is drawn from the upper half of its step.
+// Devices that lost the same broker at the same moment then come back
+// spread over the whole half-step instead of all at once, while none of
+// them retries sooner than half the step.
+class Backoff {
+public:
+    Backoff(unsigned long baseMs, unsigned long maxMs);
+
+    // Delay before the next attempt, given a random number; counts a failure
+    unsigned long next(uint32_t entropy);
+    // Delay before a first attempt: anywhere within one base step
+    unsigned long first(uint32_t entropy) const { return entropy % (base + 1); }
+    void reset() { failed = 0; }
+
+    uint8_t failures() const { return failed; }
+
+private:
+    unsigned long base;
+    unsigned long max;
+    uint8_t failed;
+};
+
+#endif
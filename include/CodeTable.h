@@ -0,0 +1,164 @@
+#ifndef CODE_TABLE_H
+#define CODE_TABLE_H
+
+#include <stdint.h>
+
+// Fixed-capacity hash table keyed by RF code, for per-code state such as
+// debounce times. Open addressing with linear probing over one flat array,
+// so it never allocates. Entries expire ttl ms after they were last stored;
+// when the table is full, a clock sweep evicts an expired entry if there is
+// one, else one that has not been looked up since the hand last passed it.
+//
+// Capacity must be a power of two. At most 3/4 of it is filled, which keeps
+// probe sequences short.
+template <typename Value, uint16_t Capacity>
+class CodeTable {
+public:
+    typedef unsigned long Key;
+
+    explicit CodeTable(unsigned long ttl)
+        : ttl(ttl), count(0), hand(0), evicted(0), expired(0) {
+        for (uint16_t i = 0; i < Capacity; i++) {
+            slots[i].used = false;
+        }
+    }
+
+    // Entry for key stored less than ttl ms before now, or null
+    Value* find(Key key, unsigned long now) {
+        int i = lookup(key);
+        if (i < 0) {
+            return 0;
+        }
+        if (now - slots[i].stamp >= ttl) {
+            expired++;
+            remove(i);
+            return 0;
+        }
+        slots[i].referenced = true;
+        return &slots[i].value;
+    }
+
+    // Entry for key, created (value-initialized) if absent or expired. Its
+    // lifetime restarts at now.
+    Value& store(Key key, unsigned long now) {
+        int i = lookup(key);
+        if (i >= 0 && now - slots[i].stamp >= ttl) {
+            expired++;
+            remove(i);
+            i = -1;
+        }
+        if (i < 0) {
+            if (count >= kMaxCount) {
+                evict(now);
+            }
+            i = home(key);
+            while (slots[i].used) {
+                i = (i + 1) & kMask;
+            }
+            slots[i].used = true;
+            slots[i].key = key;
+            slots[i].value = Value();
+            count++;
+        }
+        slots[i].stamp = now;
+        slots[i].referenced = true;
+        return slots[i].value;
+    }
+
+    bool erase(Key key) {
+        int i = lookup(key);
+        if (i < 0) {
+            return false;
+        }
+        remove(i);
+        return true;
+    }
+
+    uint16_t size() const { return count; }
+    uint16_t capacity() const { return kMaxCount; }
+    // live entries dropped to make room
+    unsigned long evictionCount() const { return evicted; }
+    // entries dropped because they outlived ttl
+    unsigned long expiryCount() const { return expired; }
+
+private:
+    static constexpr uint8_t log2(uint16_t n) {
+        return (n <= 1) ? 0 : 1 + log2(n >> 1);
+    }
+
+    static constexpr uint16_t kMask = Capacity - 1;
+    static constexpr uint8_t kBits = log2(Capacity);
+    static constexpr uint16_t kMaxCount = Capacity - Capacity / 4;
+    static_assert(Capacity >= 4 && (Capacity & (Capacity - 1)) == 0,
+                  "CodeTable capacity must be a power of two, at least 4");
+
+    struct Slot {
+        Key key;
+        unsigned long stamp;
+        Value value;
+        bool used;
+        bool referenced;
+    };
+
+    // Fibonacci hashing: the top bits of key * 2^32/phi
+    static uint16_t home(Key key) {
+        return (uint32_t)((uint32_t)key * 2654435769u) >> (32 - kBits);
+    }
+
+    int lookup(Key key) const {
+        for (uint16_t i = home(key); slots[i].used; i = (i + 1) & kMask) {
+            if (slots[i].key == key) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Backward-shift deletion: pull later entries of the probe run into the
+    // hole, so lookups never need tombstones.
+    void remove(uint16_t hole) {
+        slots[hole].used = false;
+        count--;
+        for (uint16_t j = (hole + 1) & kMask; slots[j].used; j = (j + 1) & kMask) {
+            const uint16_t h = home(slots[j].key);
+            if (((j - h) & kMask) >= ((j - hole) & kMask)) {
+                slots[hole] = slots[j];
+                slots[j].used = false;
+                hole = j;
+            }
+        }
+    }
+
+    void evict(unsigned long now) {
+        // every entry has its reference bit cleared within one turn, so two
+        // turns always find a victim
+        for (uint16_t n = 0; n < 2 * Capacity; n++) {
+            Slot& s = slots[hand];
+            const uint16_t i = hand;
+            hand = (hand + 1) & kMask;
+            if (!s.used) {
+                continue;
+            }
+            if (now - s.stamp >= ttl) {
+                expired++;
+                remove(i);
+                return;
+            }
+            if (!s.referenced) {
+                evicted++;
+                remove(i);
+                return;
+            }
+            s.referenced = false;
+        }
+    }
+
+    Slot slots[Capacity];
+    unsigned long ttl;
+    uint16_t count;
+    uint16_t hand;
+    unsigned long evicted;
+    unsigned long expired;
+};
+
+#endif
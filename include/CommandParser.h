@@ -0,0 +1,26 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <stdint.h>
+
+// Highest switch number a "swN...:V" command can address
+#define COMMAND_MAX_SWITCHES 8
+
+// One MQTT command, parsed in place from the payload bytes:
+//   swN[N...]:V                  switches N... (1-based, any subset) to V (0/1)
+//   ping
+//   rate:<code>:<burst>:<ms>     per-code publish rate override
+struct Command {
+    enum Type { SWITCH, PING, RATE, TYPE_COUNT };
+
+    Type type;
+    uint8_t mask;               // SWITCH: bit n-1 set for switch n
+    uint8_t value;              // SWITCH: 0 or 1
+    unsigned long args[3];      // RATE: code, burst, interval
+};
+
+// Parses payload[0..length), which need not be null-terminated and is never
+// written to. Trailing whitespace is ignored.
+bool parseCommand(const uint8_t* payload, unsigned int length, Command& command);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef FLASH_AREA_H
+#define FLASH_AREA_H
+
+#include <stdint.h>
+
+#define FLASH_AREA_SECTOR_SIZE 4096
+
+// A run of erase sectors in the flash filesystem area, which this firmware
+// does not use as a filesystem (eagle.flash.1m64.ld: 16 sectors of 4 KB).
+// The logs kept in flash each get their own run and reach it only through
+// read(), write() and erase(). Offsets are relative to the start of the
+// run, and data and sizes must be 4-byte aligned, as on the chip.
+//
+// Desktop builds (RCSWITCH_HOST) keep the filesystem area in RAM, with NOR
+// semantics: erase() sets bytes to 0xFF and write() can only clear bits.
+struct FlashArea {
+    uint32_t base;      // flash offset of the first sector
+    uint16_t sectors;   // 0 if the area does not exist
+
+    // false on a flash error or outside the area
+    bool read(uint32_t offset, uint32_t* data, uint32_t size) const;
+    bool write(uint32_t offset, const uint32_t* data, uint32_t size) const;
+    bool erase(uint16_t sector) const;
+};
+
+// count sectors from sector first of the filesystem area
+FlashArea flashArea(uint16_t first, uint16_t count);
+
+// CRC-8 (polynomial 0x07) that the logs use to check their records
+uint8_t flashCrc8(const uint8_t* data, unsigned int length);
+
+#if defined(RCSWITCH_HOST)
+#define FLASH_AREA_HOST_SECTORS 16
+
+// Erases the whole simulated filesystem area, like a new chip
+void flashAreaHostErase();
+// The simulated area, for tests that tear or corrupt records
+uint8_t* flashAreaHostData();
+// Times sector (of the whole area) has been erased
+unsigned long flashAreaHostEraseCount(uint16_t sector);
+#endif
+
+#endif
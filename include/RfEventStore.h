@@ -0,0 +1,106 @@
+#ifndef RF_EVENT_STORE_H
+#define RF_EVENT_STORE_H
+
+#include <stdint.h>
+#include "FlashArea.h"
+
+#ifndef RF_EVENT_RAM_SIZE
+#define RF_EVENT_RAM_SIZE 32
+#endif
+// Sequence numbers reserved per mark record, see reserve()
+#ifndef RF_EVENT_SEQ_BLOCK
+#define RF_EVENT_SEQ_BLOCK 256
+#endif
+
+// One received RF code waiting to be published
+struct RfEvent {
+    uint32_t seq;       // increases by one per event, across restarts
+    uint32_t time;      // millis() when received
+    uint32_t code;
+    uint8_t bits;
+    uint8_t protocol;
+};
+
+// FIFO of RF events that could not be published yet. Events are kept in a
+// RAM ring; when that is full, the oldest of them move on to a ring of
+// records in flash, so a long outage or a restart does not lose them. Every
+// flash event is older than every RAM event, so reading the flash ring
+// first and then the RAM ring gives all of them in order.
+//
+// A flash sector is erased once all its events are delivered. Events of a
+// partly delivered sector are delivered again after a restart; their
+// sequence numbers let the receiver drop the duplicates. When the flash
+// ring is full, its oldest sector is dropped to make room. Sequence numbers
+// are reserved in blocks by mark records, so they keep counting up across
+// restarts even when the ring was empty.
+class RfEventStore {
+public:
+    RfEventStore();
+
+    // Recovers the events left in area; false if the area does not exist,
+    // in which case only the RAM ring is used
+    bool begin(const FlashArea& area);
+
+    void push(uint32_t code, uint8_t bits, uint8_t protocol, unsigned long now);
+    // Oldest event, which stays queued until pop()
+    bool peek(RfEvent& event);
+    // Up to max of the oldest events, oldest first; returns how many
+    unsigned int peek(RfEvent* events, unsigned int max);
+    void pop();
+    void pop(unsigned int count);
+    // Moves every RAM event to flash, e.g. before a restart
+    void persist();
+
+    bool empty() const { return ramCount == 0 && flashCount == 0; }
+    unsigned long size() const { return ramCount + flashCount; }
+    // Whether event.time is a millis() of this boot
+    bool fromThisBoot(const RfEvent& event) const { return (int32_t)(event.seq - bootSeq) >= 0; }
+
+    // events moved to flash / lost to a full flash ring
+    unsigned long spilledCount() const { return spilled; }
+    unsigned long droppedCount() const { return dropped; }
+
+private:
+    // An event, or a mark reserving sequence numbers below time
+    struct Record {
+        uint32_t seq;
+        uint32_t time;
+        uint32_t code;
+        uint8_t bits;
+        uint8_t protocol;
+        uint8_t magic;
+        uint8_t crc;
+    };
+
+    bool readRecord(uint16_t sector, uint16_t slot, Record& record) const;
+    bool readEvent(uint16_t sector, uint16_t slot, RfEvent& event) const;
+    uint16_t findFree(uint16_t sector) const;
+    uint16_t readEnd() const;
+    bool seekFlash(RfEvent& event);
+    bool spill(const RfEvent& event);
+    void reserve();
+    bool writeMark(uint32_t limit);
+    bool append(Record& record);
+    void nextReadSector();
+    void dropSector();
+
+    RfEvent ram[RF_EVENT_RAM_SIZE];
+    uint8_t ramHead;
+    uint8_t ramCount;
+
+    FlashArea area;         // flash ring
+    uint16_t readSector;    // oldest event in flash
+    uint16_t readSlot;
+    uint16_t writeSector;   // next record to write
+    uint16_t writeSlot;
+    bool writeReady;        // writeSlot..end of the sector is erased
+    unsigned long flashCount;
+
+    uint32_t nextSeq;
+    uint32_t bootSeq;       // first sequence number of this boot
+    uint32_t reserved;      // numbers below this are covered by a mark
+    unsigned long spilled;
+    unsigned long dropped;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef RF_RATE_POLICY_H
+#define RF_RATE_POLICY_H
+
+#include <stdint.h>
+#include "CodeTable.h"
+
+#ifndef RF_RATE_TABLE_SIZE
+#define RF_RATE_TABLE_SIZE 64
+#endif
+#ifndef RF_RATE_MAX_OVERRIDES
+#define RF_RATE_MAX_OVERRIDES 8
+#endif
+// A code's bucket is forgotten this long after its last event; no rule may
+// take longer than this to refill completely (burst * intervalMs)
+#ifndef RF_RATE_IDLE_MS
+#define RF_RATE_IDLE_MS 10000
+#endif
+
+// Token bucket: up to burst events at once, refilled by one every intervalMs
+struct RfRateRule {
+    uint8_t burst;
+    uint16_t intervalMs;
+};
+
+// Decides which received codes get published. Every code has its own
+// bucket, so sensors never suppress each other; a shared bucket on top
+// tells a flood of distinct codes apart from normal traffic. Codes over the
+// shared budget are not dropped: the caller queues them and paces their
+// delivery, so the broker is never swamped and no sensor goes unreported.
+// Codes that are meant to repeat (hold-to-repeat remotes) can get a rule of
+// their own.
+class RfRatePolicy {
+public:
+    enum Verdict { ALLOW, CODE_LIMITED, GLOBAL_LIMITED };
+
+    RfRatePolicy(RfRateRule perCode, RfRateRule global);
+
+    // Takes a token for code if its bucket has one (else CODE_LIMITED), and
+    // one from the global bucket if that has one (else GLOBAL_LIMITED: to be
+    // delivered paced rather than at once)
+    Verdict check(unsigned long code, unsigned long now);
+
+    // Rule for one code; burst 0 removes the override. False if the rule
+    // refills too slowly or all override slots are taken.
+    bool setOverride(unsigned long code, RfRateRule rule);
+
+    unsigned long codeLimitedCount() const { return codeLimited; }
+    unsigned long globalLimitedCount() const { return globalLimited; }
+    const CodeTable<unsigned long, RF_RATE_TABLE_SIZE>& codes() const { return buckets; }
+
+private:
+    struct Override {
+        unsigned long code;
+        RfRateRule rule;
+    };
+
+    const RfRateRule& ruleFor(unsigned long code) const;
+    static bool conforms(unsigned long tat, const RfRateRule& rule, unsigned long now);
+    static unsigned long take(unsigned long tat, const RfRateRule& rule, unsigned long now);
+
+    RfRateRule perCode;
+    RfRateRule global;
+    unsigned long globalTat;
+    // Per code: theoretical arrival time of the bucket (GCRA), see take()
+    CodeTable<unsigned long, RF_RATE_TABLE_SIZE> buckets;
+    Override overrides[RF_RATE_MAX_OVERRIDES];
+    uint8_t overrideCount;
+    unsigned long codeLimited;
+    unsigned long globalLimited;
+};
+
+#endif
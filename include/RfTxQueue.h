@@ -0,0 +1,55 @@
+#ifndef RF_TX_QUEUE_H
+#define RF_TX_QUEUE_H
+
+#include <stdint.h>
+#include <RCSwitch.h>
+
+#ifndef RF_TX_QUEUE_SIZE
+#define RF_TX_QUEUE_SIZE 16
+#endif
+
+// One RF transmission requested over MQTT
+struct RfTxRequest {
+    RCSwitch::Code code;
+    uint8_t bits;
+    uint8_t protocol;
+    uint8_t repeats;
+    uint8_t priority;   // higher goes first
+};
+
+// Bounded priority queue of pending RF transmissions. Requests for a code
+// that is already pending are merged into the pending entry, so a burst of
+// identical commands is sent once. Equal priorities leave in arrival order.
+class RfTxQueue {
+public:
+    enum Result { QUEUED, COALESCED, REPLACED, REJECTED };
+
+    RfTxQueue();
+
+    // Adds a request. When full, the newest request of the lowest priority
+    // makes room for one of higher priority (REPLACED, and it is returned in
+    // evicted); otherwise the new request is REJECTED.
+    Result push(const RfTxRequest& request, RfTxRequest& evicted);
+    bool pop(RfTxRequest& request);
+
+    uint8_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    unsigned int droppedCount() const { return dropped; }
+    unsigned int coalescedCount() const { return coalesced; }
+
+private:
+    struct Entry {
+        RfTxRequest request;
+        uint32_t seq;
+    };
+
+    int findLowest() const;
+
+    Entry entries[RF_TX_QUEUE_SIZE];
+    uint8_t count;
+    uint32_t nextSeq;
+    unsigned int dropped;
+    unsigned int coalesced;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 8
+#endif
+#ifndef SCHEDULER_TICK_MS
+#define SCHEDULER_TICK_MS 10
+#endif
+#ifndef SCHEDULER_WHEEL_SLOTS
+#define SCHEDULER_WHEEL_SLOTS 64     // power of two
+#endif
+
+// Cooperative scheduler for the main loop: jobs run from run(), never from
+// an interrupt, and must return quickly instead of calling delay().
+//
+// Deadlines are kept on a timer wheel of SCHEDULER_WHEEL_SLOTS slots of
+// SCHEDULER_TICK_MS each. A task due in n ticks sits in slot n mod slots,
+// so scheduling and cancelling are O(1) and each tick only looks at the
+// tasks of one slot; a deadline more than one turn away just stays in its
+// slot until its tick comes round.
+class Scheduler {
+public:
+    typedef void (*Job)();
+    typedef uint8_t TaskId;
+    static const TaskId NO_TASK = 0xFF;
+
+    Scheduler();
+
+    // Registers a job, not yet scheduled; NO_TASK if all slots are taken
+    TaskId add(Job job);
+
+    // Runs the task once, delayMs from now; replaces an earlier deadline
+    void after(TaskId task, unsigned long delayMs);
+    // Runs the task every periodMs, the first time periodMs from now
+    void every(TaskId task, unsigned long periodMs);
+    void cancel(TaskId task);
+    bool pending(TaskId task) const;
+
+    // Runs every job that has come due by now
+    void run(unsigned long now);
+
+    // Calls to run() that found more than one tick gone by, i.e. the loop
+    // was held up and jobs ran late
+    unsigned long lateCount() const { return late; }
+
+private:
+    enum State { IDLE, WAITING, READY };
+
+    struct Task {
+        Job job;
+        uint32_t due;          // tick to run at
+        uint32_t period;       // ticks, 0 for one-shot
+        TaskId next;           // next task in the same wheel slot
+        uint8_t state;
+    };
+
+    static uint32_t ticks(unsigned long ms);
+    void schedule(TaskId task, uint32_t due);
+    void unlink(TaskId task);
+    void advance(uint16_t slot, uint32_t tick);
+
+    Task tasks[SCHEDULER_MAX_TASKS];
+    TaskId wheel[SCHEDULER_WHEEL_SLOTS];
+    uint8_t count;
+    uint32_t current;          // last tick processed
+    unsigned long lastMs;      // millis() at that tick
+    unsigned long late;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef STATE_LOG_H
+#define STATE_LOG_H
+
+#include <stdint.h>
+#include "FlashArea.h"
+
+// Relay state kept as an append-only log of small records in a few sectors
+// of the flash filesystem area, instead of one EEPROM sector rewritten per
+// command.
+//
+// Every record carries a sequence number and a CRC; the valid record with
+// the highest sequence number is the current state. Records are appended
+// within a sector and the log moves on to the next sector, erasing it, when
+// one is full, so each sector is erased once per 512 records times the
+// number of sectors. save() only marks the state dirty; loop() writes it
+// once the commit delay has passed since the first unsaved change, so a
+// burst of commands costs a single record.
+class StateLog {
+public:
+    explicit StateLog(unsigned long commitDelayMs);
+
+    // Locates the log in area; false if the area does not exist
+    bool begin(const FlashArea& area);
+    // Latest saved state; false if nothing valid was found
+    bool restore(uint16_t& state) const;
+
+    void save(uint16_t state, unsigned long now);
+    void loop(unsigned long now);
+    // Writes a pending state right away, e.g. before a restart
+    void flush();
+
+    unsigned long commitCount() const { return commits; }
+    // save() calls absorbed into a later record
+    unsigned long coalescedCount() const { return coalesced; }
+
+private:
+    struct Record {
+        uint32_t seq;
+        uint16_t state;
+        uint8_t magic;
+        uint8_t crc;
+    };
+
+    static bool valid(const Record& record);
+    bool readRecord(uint16_t sector, uint16_t slot, Record& record) const;
+    uint16_t findFree(uint16_t sector) const;
+    bool append(uint16_t state);
+
+    unsigned long commitDelay;
+    FlashArea area;
+    uint16_t sector;        // sector written to
+    uint16_t slot;          // next free record in it
+    bool sectorReady;       // slot..end of the sector is known to be erased
+    uint32_t seq;           // sequence number of the latest record
+    uint16_t saved;
+    bool haveSaved;
+    uint16_t pending;
+    bool dirty;
+    unsigned long dirtySince;
+    unsigned long commits;
+    unsigned long coalesced;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef SWITCH_BANK_H
+#define SWITCH_BANK_H
+
+#include <stdint.h>
+#if defined(RCSWITCH_HOST) // desktop build, see RCSwitchHost.h
+#include "RCSwitchHost.h"
+#else
+#include <Arduino.h>
+#endif
+
+// A fixed set of relay outputs, defined once by its pin list:
+//   typedef SwitchBank<14, 13, 12, 4> Switches;
+// Channel n (0-based) is the n-th pin; a Mask has bit n set for channel n.
+// The bank tracks what it last wrote, so callers can snapshot and restore
+// the whole state as one value.
+//
+// On the ESP8266 all channels on GPIO0..15 change together: the new state
+// is written as one set mask and one clear mask to the GPIO output
+// registers, so relays switched as a group do so at the same instant.
+// Desktop builds (RCSWITCH_HOST) write each pin through digitalWrite().
+template <uint8_t... Pins>
+class SwitchBank {
+public:
+    typedef uint16_t Mask;
+
+    static constexpr uint8_t size() { return sizeof...(Pins); }
+    static constexpr Mask all() { return (Mask)((1UL << sizeof...(Pins)) - 1); }
+
+    SwitchBank() : state(0) {}
+
+    void begin() {
+        for (uint8_t i = 0; i < size(); i++) {
+            pinMode(pins[i], OUTPUT);
+        }
+    }
+
+    // Switches the channels in mask on or off; returns those that changed
+    Mask apply(Mask mask, bool value) {
+        mask &= all();
+        const Mask changed = value ? (mask & ~state) : (mask & state);
+        write(value ? changed : 0, value ? 0 : changed);
+        state = value ? (state | mask) : (state & ~mask);
+        return changed;
+    }
+
+    bool get(uint8_t channel) const { return (state >> channel) & 1; }
+    Mask snapshot() const { return state; }
+
+    // Sets every channel to its bit in saved
+    void restore(Mask saved) {
+        saved &= all();
+        write(saved, all() & ~saved);
+        state = saved;
+    }
+
+    // GPOS/GPOC values for a change: the GPIO bits of the channels in on
+    // and in off. Channels above GPIO15 are not in the registers.
+    static void registerMasks(Mask on, Mask off, uint32_t& set, uint32_t& clear) {
+        set = 0;
+        clear = 0;
+        for (uint8_t i = 0; i < size(); i++) {
+            if (pins[i] < 16) {
+                if (on & (1 << i)) set |= 1UL << pins[i];
+                if (off & (1 << i)) clear |= 1UL << pins[i];
+            }
+        }
+    }
+
+private:
+    static_assert(sizeof...(Pins) >= 1 && sizeof...(Pins) <= 16, "SwitchBank holds 1 to 16 channels");
+    static constexpr uint8_t pins[sizeof...(Pins)] = { Pins... };
+
+    // Turns on the channels in on and off those in off
+#if defined(ESP8266) && !defined(RCSWITCH_HOST)
+    static void write(Mask on, Mask off) {
+        uint32_t set;
+        uint32_t clear;
+        registerMasks(on, off, set, clear);
+        for (uint8_t i = 0; i < size(); i++) {
+            if (pins[i] >= 16 && ((on | off) & (1 << i))) {
+                // GPIO16 sits in the RTC block, outside GPOS/GPOC
+                digitalWrite(pins[i], (on & (1 << i)) ? HIGH : LOW);
+            }
+        }
+        GPOS = set;
+        GPOC = clear;
+    }
+#else
+    static void write(Mask on, Mask off) {
+        for (uint8_t i = 0; i < size(); i++) {
+            if ((on | off) & (1 << i)) {
+                digitalWrite(pins[i], (on & (1 << i)) ? HIGH : LOW);
+            }
+        }
+    }
+#endif
+
+    Mask state;
+};
+
+template <uint8_t... Pins>
+constexpr uint8_t SwitchBank<Pins...>::pins[sizeof...(Pins)];
+
+#endif
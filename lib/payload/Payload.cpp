@@ -0,0 +1,209 @@
+#include "Payload.h"
+#include <string.h>
+
+namespace {
+
+class Writer {
+public:
+    Writer(uint8_t* out, size_t capacity) : out(out), capacity(capacity), pos(0), overflow(false) {}
+
+    void u8(uint8_t value) {
+        if (pos < capacity) {
+            out[pos++] = value;
+        } else {
+            overflow = true;
+        }
+    }
+
+    void var(uint64_t value) {
+        while (value >= 0x80) {
+            u8((uint8_t)value | 0x80);
+            value >>= 7;
+        }
+        u8((uint8_t)value);
+    }
+
+    void svar(int64_t value) {
+        var(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+
+    void raw(const void* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            u8(((const uint8_t*)data)[i]);
+        }
+    }
+
+    size_t size() const { return overflow ? 0 : pos; }
+
+private:
+    uint8_t* out;
+    size_t capacity;
+    size_t pos;
+    bool overflow;
+};
+
+class Reader {
+public:
+    Reader(const uint8_t* in, size_t length) : in(in), length(length), pos(0), bad(false) {}
+
+    uint8_t u8() {
+        if (pos < length) {
+            return in[pos++];
+        }
+        bad = true;
+        return 0;
+    }
+
+    uint64_t var() {
+        uint64_t value = 0;
+        for (uint8_t shift = 0; shift < 64; shift += 7) {
+            const uint8_t b = u8();
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+        bad = true;
+        return 0;
+    }
+
+    int64_t svar() {
+        const uint64_t value = var();
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    // var that must fit in max
+    uint64_t var(uint64_t max) {
+        const uint64_t value = var();
+        if (value > max) {
+            bad = true;
+        }
+        return value;
+    }
+
+    void raw(void* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            ((uint8_t*)data)[i] = u8();
+        }
+    }
+
+    bool done() const { return !bad && pos == length; }
+    bool failed() const { return bad; }
+
+private:
+    const uint8_t* in;
+    size_t length;
+    size_t pos;
+    bool bad;
+};
+
+}
+
+size_t payloadEncode(const PayloadMessage& message, uint8_t* out, size_t capacity) {
+    Writer w(out, capacity);
+    w.u8(PAYLOAD_VERSION);
+    w.u8(message.type);
+    for (uint8_t i = 0; i < 8; i++) {
+        w.u8((uint8_t)(message.device >> (8 * i)));
+    }
+
+    switch (message.type) {
+    case PAYLOAD_RF_EVENTS:
+        if (message.eventCount > PAYLOAD_MAX_RF_EVENTS) {
+            return 0;
+        }
+        w.var(message.seq);
+        w.var(message.age == PAYLOAD_AGE_UNKNOWN ? 0 : (uint64_t)message.age + 1);
+        w.var(message.eventCount);
+        for (uint8_t i = 0; i < message.eventCount; i++) {
+            const PayloadRfEvent& event = message.events[i];
+            w.var(event.code);
+            w.u8(event.bits);
+            w.u8(event.protocol);
+            w.var(event.dt);
+        }
+        break;
+    case PAYLOAD_SWITCH:
+        w.var(message.mask);
+        w.u8(message.value);
+        w.var(message.state);
+        break;
+    case PAYLOAD_STATUS: {
+        const size_t ssidLength = strnlen(message.ssid, PAYLOAD_MAX_SSID);
+        w.var(message.state);
+        w.svar(message.rssi);
+        w.var(message.interval);
+        w.raw(message.ip, 4);
+        w.u8((uint8_t)ssidLength);
+        w.raw(message.ssid, ssidLength);
+        break;
+    }
+    case PAYLOAD_RF_TX:
+    case PAYLOAD_RATE:
+        w.var(message.code);
+        w.u8(message.status);
+        break;
+    default:
+        return 0;
+    }
+    return w.size();
+}
+
+bool payloadDecode(const uint8_t* in, size_t length, PayloadMessage& message) {
+    Reader r(in, length);
+    if (r.u8() != PAYLOAD_VERSION) {
+        return false;
+    }
+    message.type = r.u8();
+    message.device = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        message.device |= (uint64_t)r.u8() << (8 * i);
+    }
+
+    switch (message.type) {
+    case PAYLOAD_RF_EVENTS: {
+        message.seq = (uint32_t)r.var(0xFFFFFFFF);
+        const uint64_t age = r.var(0xFFFFFFFF);
+        message.age = age ? (uint32_t)(age - 1) : PAYLOAD_AGE_UNKNOWN;
+        message.eventCount = (uint8_t)r.var(PAYLOAD_MAX_RF_EVENTS);
+        if (r.failed()) {
+            return false;
+        }
+        for (uint8_t i = 0; i < message.eventCount && !r.failed(); i++) {
+            PayloadRfEvent& event = message.events[i];
+            event.code = (uint32_t)r.var(0xFFFFFFFF);
+            event.bits = r.u8();
+            event.protocol = r.u8();
+            event.dt = (uint32_t)r.var(0xFFFFFFFF);
+        }
+        break;
+    }
+    case PAYLOAD_SWITCH:
+        message.mask = (uint16_t)r.var(0xFFFF);
+        message.value = r.u8();
+        message.state = (uint16_t)r.var(0xFFFF);
+        break;
+    case PAYLOAD_STATUS: {
+        message.state = (uint16_t)r.var(0xFFFF);
+        const int64_t rssi = r.svar();
+        message.rssi = (int8_t)rssi;
+        message.interval = (uint32_t)r.var(0xFFFFFFFF);
+        r.raw(message.ip, 4);
+        const uint8_t ssidLength = r.u8();
+        if (ssidLength > PAYLOAD_MAX_SSID || rssi < -128 || rssi > 127) {
+            return false;
+        }
+        r.raw(message.ssid, ssidLength);
+        message.ssid[ssidLength] = '\0';
+        break;
+    }
+    case PAYLOAD_RF_TX:
+    case PAYLOAD_RATE:
+        message.code = (uint32_t)r.var(0xFFFFFFFF);
+        message.status = r.u8();
+        break;
+    default:
+        return false;
+    }
+    return r.done();
+}
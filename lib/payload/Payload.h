@@ -0,0 +1,78 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Compact binary form of the messages the switch publishes, shared by the
+// firmware and the host tools. Every message starts with a fixed header
+//
+//   version  u8      PAYLOAD_VERSION
+//   type     u8      PayloadType
+//   device   u64 LE  the numeric DEVICE_ID, e.g. 1225102502120006
+//
+// followed by the fields of its type. "var" is an unsigned LEB128 varint
+// (7 bits per byte, low group first), "svar" a zigzag-encoded signed one.
+//
+//   RF_EVENTS  seq var, age+1 var (0: unknown), count var, then per event:
+//              code var, bits u8, protocol u8, dt var
+//   SWITCH     mask var, value u8, state var (all relays, bit n = switch n+1)
+//   STATUS     state var, rssi svar, interval var (ms), ip 4 bytes,
+//              ssid length u8 + bytes
+//   RF_TX      code var, status u8 (0 sent, 1 queue full)
+//   RATE       code var, status u8 (0 set, 1 rejected)
+//
+// Decoders reject a newer version, an unknown type and trailing bytes; a
+// new field means a new version.
+#define PAYLOAD_VERSION 1
+#define PAYLOAD_HEADER_SIZE 10
+#define PAYLOAD_MAX_RF_EVENTS 16
+#define PAYLOAD_MAX_SSID 32
+#define PAYLOAD_AGE_UNKNOWN 0xFFFFFFFF
+
+enum PayloadType {
+    PAYLOAD_RF_EVENTS = 1,
+    PAYLOAD_SWITCH,
+    PAYLOAD_STATUS,
+    PAYLOAD_RF_TX,
+    PAYLOAD_RATE,
+    PAYLOAD_TYPE_END
+};
+
+struct PayloadRfEvent {
+    uint32_t code;
+    uint8_t bits;
+    uint8_t protocol;
+    uint32_t dt;            // ms after the first event of the message
+};
+
+// One message; only the fields of its type are used
+struct PayloadMessage {
+    uint8_t type;
+    uint64_t device;
+
+    // RF_EVENTS
+    uint32_t seq;           // of the first event
+    uint32_t age;           // ms since the first event, or PAYLOAD_AGE_UNKNOWN
+    uint8_t eventCount;
+    PayloadRfEvent events[PAYLOAD_MAX_RF_EVENTS];
+
+    // SWITCH, STATUS
+    uint16_t mask;
+    uint8_t value;
+    uint16_t state;
+    int8_t rssi;
+    uint32_t interval;
+    uint8_t ip[4];
+    char ssid[PAYLOAD_MAX_SSID + 1];
+
+    // RF_TX, RATE
+    uint32_t code;
+    uint8_t status;
+};
+
+// Bytes written to out, 0 if the message does not fit or is malformed
+size_t payloadEncode(const PayloadMessage& message, uint8_t* out, size_t capacity);
+bool payloadDecode(const uint8_t* in, size_t length, PayloadMessage& message);
+
+#endif
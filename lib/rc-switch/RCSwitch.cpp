@@ -54,6 +54,31 @@
     #define VAR_ISR_ATTR
 #endif
 
+/*
+ * One-shot timer for asynchronous transmissions. Platforms without one
+ * fall back to sending synchronously in sendAsync().
+ */
+#if defined(ESP8266)
+    // timer1 at 80 MHz / 16 counts 5 ticks per microsecond; it is not
+    // available to analogWrite() or tone() while a transmission runs
+    #define RCSWITCH_TX_TIMER
+    #define TX_TIMER_BEGIN(handler) do { timer1_attachInterrupt(handler); timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE); } while (0)
+    #define TX_TIMER_ARM(us) timer1_write((uint32_t)(us) * 5)
+    #define TX_TIMER_END() do { timer1_disable(); timer1_detachInterrupt(); } while (0)
+#elif defined(RCSWITCH_HOST)
+    #define RCSWITCH_TX_TIMER
+    #define TX_TIMER_BEGIN(handler) rcswitchHostTimer(0, 0)
+    #define TX_TIMER_ARM(us) rcswitchHostTimer((us), RCSwitch::transmitStep)
+    #define TX_TIMER_END() rcswitchHostTimer(0, 0)
+#endif
+
+// Keeps the compiler from moving queue slot accesses across the index update.
+#define RCSWITCH_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+#if (RCSWITCH_RX_QUEUE_SIZE & (RCSWITCH_RX_QUEUE_SIZE - 1)) != 0 || RCSWITCH_RX_QUEUE_SIZE > 128
+#error "RCSWITCH_RX_QUEUE_SIZE must be a power of two, at most 128"
+#endif
+
 
 /* Format for protocol definitions:
  * {pulselength, Sync bit, "0" bit, "1" bit, invertedSignal}
@@ -98,16 +123,29 @@ enum {
 };
 
 #if not defined( RCSwitchDisableReceiving )
-volatile unsigned long RCSwitch::nReceivedValue = 0;
-volatile unsigned int RCSwitch::nReceivedBitlength = 0;
-volatile unsigned int RCSwitch::nReceivedDelay = 0;
-volatile unsigned int RCSwitch::nReceivedProtocol = 0;
-int RCSwitch::nReceiveTolerance = 60;
+static_assert(numProto <= RCSWITCH_MAX_PROTOCOLS, "raise RCSWITCH_MAX_PROTOCOLS");
+#endif
+
+unsigned int RCSwitch::txPulses[2 * RCSWITCH_MAX_BITS + 2];
+volatile unsigned int RCSwitch::nTxIndex = 0;
+unsigned int RCSwitch::nTxCount = 0;
+volatile unsigned int RCSwitch::nTxRepeats = 0;
+int RCSwitch::nTxPin = -1;
+bool RCSwitch::bTxInverted = false;
+volatile bool RCSwitch::bTransmitting = false;
+volatile bool RCSwitch::bTransmitDone = false;
+void (*RCSwitch::txCallback)(void) = 0;
+
+#if not defined( RCSwitchDisableReceiving )
+RCSwitch::ProtocolMatch RCSwitch::protoMatch[numProto];
+bool RCSwitch::bMatchTablesBuilt = false;
+uint8_t RCSwitch::ratioIndex[2][RCSWITCH_MAX_PROTOCOLS];
+uint8_t RCSwitch::nRatioIndexSize[2];
 const unsigned int RCSwitch::nSeparationLimit = 4300;
 // separationLimit: minimum microseconds between received codes, closer codes are ignored.
 // according to discussion on issue #14 it might be more suitable to set the separation
 // limit to the same time as the 'low' part of the sync signal for the current protocol.
-unsigned int RCSwitch::timings[RCSWITCH_MAX_CHANGES];
+RCSwitch* volatile RCSwitch::receivers[RCSWITCH_MAX_RECEIVERS];
 #endif
 
 RCSwitch::RCSwitch() {
@@ -116,11 +154,56 @@ RCSwitch::RCSwitch() {
   this->setProtocol(1);
   #if not defined( RCSwitchDisableReceiving )
   this->nReceiverInterrupt = -1;
+  this->nReceiverSlot = -1;
   this->setReceiveTolerance(60);
-  RCSwitch::nReceivedValue = 0;
+  this->nRxHead = 0;
+  this->nRxTail = 0;
+  this->nRxOverflow = 0;
+  this->nCaptureBuffer = 0;
+  this->nPendingChanges = 0;
+  this->nPendingTime = 0;
+  this->nCaptureOverrun = 0;
+  this->bDeferredDecoding = false;
+  this->nChangeCount = 0;
+  this->nLastTime = 0;
+  this->nRepeatCount = 0;
+  this->nMinPulse = 0;
+  this->nMaxEdges = 0;
+  this->nEdgeWindow = 0;
+  this->nMaskDuration = 0;
+  this->nWindowStart = 0;
+  this->nWindowEdges = 0;
+  this->bReceiverMasked = false;
+  this->nMaskedSince = 0;
+  this->nGlitchCount = 0;
+  this->nRateLimitCount = 0;
+  this->bLowLatency = false;
+  this->llCode = 0;
+  this->llProtocol = 0;
+  this->llBitlength = 0;
+  this->llDelay = 0;
+  this->llState = 0;
+  this->llLastTime = 0;
+  this->llDelivered = 0;
+  this->nLastFrameTime = 0;
+  this->bSenderCalibration = false;
+  memset(this->senders, 0, sizeof(this->senders));
+  this->nCalibratedCount = 0;
+  if (!RCSwitch::bMatchTablesBuilt) {
+    RCSwitch::buildMatchTables();
+  }
   #endif
 }
 
+#if not defined( RCSwitchDisableReceiving )
+RCSwitch::~RCSwitch() {
+  // the interrupt slot must not outlive its instance
+  if (this->nReceiverSlot != -1) {
+    this->disableReceive();
+  }
+}
+#endif
+
 /**
   * Sets the protocol to send.
   */
@@ -150,6 +233,13 @@ void RCSwitch::setProtocol(int nProtocol, int nPulseLength) {
   this->setPulseLength(nPulseLength);
 }
 
+/**
+  * Number of predefined protocols, i.e. the highest valid nProtocol.
+  */
+int RCSwitch::getProtocolCount() {
+  return numProto;
+}
+
 
 /**
   * Sets pulse length in microseconds
@@ -170,7 +260,127 @@ void RCSwitch::setRepeatTransmit(int nRepeatTransmit) {
  */
 #if not defined( RCSwitchDisableReceiving )
 void RCSwitch::setReceiveTolerance(int nPercent) {
-  RCSwitch::nReceiveTolerance = nPercent;
+  if (nPercent < 0) {
+    nPercent = 0;
+  } else if (nPercent > 100) {
+    nPercent = 100;
+  }
+  this->nReceiveTolerance = nPercent;
+  // rounded up like the sync reciprocals, see toleranceOf()
+  this->nToleranceScale = (((uint32_t)nPercent << 16) + 99) / 100;
+}
+
+/**
+ * Select where received frames are decoded.
+ *
+ * By default the interrupt handler matches every complete frame against all
+ * protocols itself. With deferred decoding the handler only records edge
+ * durations into a double buffer, and the protocol matching runs in
+ * decodePending(), called from the main loop (available() and readFrame()
+ * do so implicitly). This keeps the interrupt short and predictable, at the
+ * cost of dropping frames while a previous one is still waiting to be
+ * decoded (see getCaptureOverrunCount()).
+ *
+ * Select the mode before enableReceive().
+ */
+void RCSwitch::setDeferredDecoding(bool bDeferred) {
+  this->bDeferredDecoding = bDeferred;
+}
+
+/**
+ * Set the shortest pulse the receiver accepts.
+ *
+ * A shorter pulse is taken for a noise spike: it and the pulse it cut in
+ * two are merged back into one, so a single spike no longer destroys the
+ * frame being received. No protocol in the built-in table uses pulses
+ * below 150 microseconds.
+ *
+ * @param nMinPulseMicros   0 to accept every pulse (the default)
+ */
+void RCSwitch::setGlitchFilter(unsigned int nMinPulseMicros) {
+  this->nMinPulse = nMinPulseMicros;
+}
+
+/**
+ * Limit the rate of receive interrupts.
+ *
+ * When more than nMaxEdges level changes arrive within nWindowMicros, the
+ * band is too noisy to carry a frame anyway; the receive interrupt is then
+ * masked for nMaskMicros so the noise stops costing CPU time. Receiving
+ * resumes on the first available()/readFrame() call after that.
+ *
+ * @param nMaxEdges   0 to disable the limit (the default)
+ */
+void RCSwitch::setEdgeRateLimit(unsigned int nMaxEdges, unsigned long nWindowMicros, unsigned long nMaskMicros) {
+  this->nMaxEdges = nMaxEdges;
+  this->nEdgeWindow = nWindowMicros;
+  this->nMaskDuration = nMaskMicros;
+}
+
+/**
+ * Learn the pulse length and jitter of every sender heard.
+ *
+ * The wide nReceiveTolerance window is needed to catch a sender the first
+ * time, but it also lets frames match the wrong protocol, and a remote
+ * whose oscillator has drifted can still fall outside it. With calibration
+ * enabled, the receiver keeps a profile of the last RCSWITCH_MAX_SENDERS
+ * senders (protocol, code, pulse length, jitter) and first tries to decode
+ * a frame as the sender whose sync it fits, with a window of only a few
+ * times that sender's jitter. The wide window remains the fallback.
+ */
+void RCSwitch::setSenderCalibration(bool bEnable) {
+  this->bSenderCalibration = bEnable;
+}
+
+/**
+ * Deliver frames after the first complete frame instead of the second.
+ *
+ * Normally a frame is only decoded once the gap after the following frame
+ * has shown that the sender repeats itself, so the code is known one full
+ * frame time after it was sent. In low latency mode the gap that ends a
+ * frame is taken as its sync (senders transmit the sync after the data),
+ * and each frame is decoded as soon as it ends. The first frame of a
+ * transmission is delivered unconfirmed; its repeats follow flagged
+ * RCSWITCH_FRAME_REPEAT, either RCSWITCH_FRAME_CANCELLED (carrying the
+ * retracted frame) when they do not agree with it, or
+ * RCSWITCH_FRAME_CONFIRMED when they do. The first agreeing repeat is
+ * delivered at once, later ones at most every RCSWITCH_HOLD_INTERVAL
+ * microseconds, so a held button keeps being reported.
+ *
+ * Select the mode before enableReceive().
+ */
+void RCSwitch::setLowLatency(bool bEnable) {
+  this->bLowLatency = bEnable;
+  this->llState = 0;
+}
+
+/**
+ * micros() when a frame was last decoded. This includes repeats that were
+ * not queued, so it tells whether a transmission is still on the air.
+ */
+unsigned long RCSwitch::getLastFrameTime() {
+  return this->nLastFrameTime;
+}
+
+/**
+ * Number of frames decoded with a learned sender's window.
+ */
+unsigned int RCSwitch::getCalibratedCount() {
+  return this->nCalibratedCount;
+}
+
+/**
+ * Number of pulses dropped by the glitch filter.
+ */
+unsigned int RCSwitch::getGlitchCount() {
+  return this->nGlitchCount;
+}
+
+/**
+ * Number of times the edge rate limit masked the receive interrupt.
+ */
+unsigned int RCSwitch::getRateLimitCount() {
+  return this->nRateLimitCount;
 }
 #endif
   
@@ -199,7 +409,7 @@ void RCSwitch::disableTransmit() {
  * @param nDevice       Number of the switch itself (1..3)
  */
 void RCSwitch::switchOn(char sGroup, int nDevice) {
-  this->sendTriState( this->getCodeWordD(sGroup, nDevice, true) );
+  this->send(codeWordD(sGroup, nDevice, true));
 }
 
 /**
@@ -209,7 +419,7 @@ void RCSwitch::switchOn(char sGroup, int nDevice) {
  * @param nDevice       Number of the switch itself (1..3)
  */
 void RCSwitch::switchOff(char sGroup, int nDevice) {
-  this->sendTriState( this->getCodeWordD(sGroup, nDevice, false) );
+  this->send(codeWordD(sGroup, nDevice, false));
 }
 
 /**
@@ -220,7 +430,7 @@ void RCSwitch::switchOff(char sGroup, int nDevice) {
  * @param nDevice  Number of device (1..4)
   */
 void RCSwitch::switchOn(char sFamily, int nGroup, int nDevice) {
-  this->sendTriState( this->getCodeWordC(sFamily, nGroup, nDevice, true) );
+  this->send(codeWordC(sFamily, nGroup, nDevice, true));
 }
 
 /**
@@ -231,7 +441,7 @@ void RCSwitch::switchOn(char sFamily, int nGroup, int nDevice) {
  * @param nDevice  Number of device (1..4)
  */
 void RCSwitch::switchOff(char sFamily, int nGroup, int nDevice) {
-  this->sendTriState( this->getCodeWordC(sFamily, nGroup, nDevice, false) );
+  this->send(codeWordC(sFamily, nGroup, nDevice, false));
 }
 
 /**
@@ -241,7 +451,7 @@ void RCSwitch::switchOff(char sFamily, int nGroup, int nDevice) {
  * @param nChannelCode  Number of the switch itself (1..4)
  */
 void RCSwitch::switchOn(int nAddressCode, int nChannelCode) {
-  this->sendTriState( this->getCodeWordB(nAddressCode, nChannelCode, true) );
+  this->send(codeWordB(nAddressCode, nChannelCode, true));
 }
 
 /**
@@ -251,7 +461,7 @@ void RCSwitch::switchOn(int nAddressCode, int nChannelCode) {
  * @param nChannelCode  Number of the switch itself (1..4)
  */
 void RCSwitch::switchOff(int nAddressCode, int nChannelCode) {
-  this->sendTriState( this->getCodeWordB(nAddressCode, nChannelCode, false) );
+  this->send(codeWordB(nAddressCode, nChannelCode, false));
 }
 
 /**
@@ -285,7 +495,7 @@ void RCSwitch::switchOff(const char* sGroup, int nChannel) {
  * @param sDevice       Code of the switch device (refers to DIP switches 6..10 (A..E) where "1" = on and "0" = off, if all DIP switches are on it's "11111")
  */
 void RCSwitch::switchOn(const char* sGroup, const char* sDevice) {
-  this->sendTriState( this->getCodeWordA(sGroup, sDevice, true) );
+  this->send(codeWordA(sGroup, sDevice, true));
 }
 
 /**
@@ -295,178 +505,30 @@ void RCSwitch::switchOn(const char* sGroup, const char* sDevice) {
  * @param sDevice       Code of the switch device (refers to DIP switches 6..10 (A..E) where "1" = on and "0" = off, if all DIP switches are on it's "11111")
  */
 void RCSwitch::switchOff(const char* sGroup, const char* sDevice) {
-  this->sendTriState( this->getCodeWordA(sGroup, sDevice, false) );
-}
-
-
-/**
- * Returns a char[13], representing the code word to be send.
- *
- */
-char* RCSwitch::getCodeWordA(const char* sGroup, const char* sDevice, bool bStatus) {
-  static char sReturn[13];
-  int nReturnPos = 0;
-
-  for (int i = 0; i < 5; i++) {
-    sReturn[nReturnPos++] = (sGroup[i] == '0') ? 'F' : '0';
-  }
-
-  for (int i = 0; i < 5; i++) {
-    sReturn[nReturnPos++] = (sDevice[i] == '0') ? 'F' : '0';
-  }
-
-  sReturn[nReturnPos++] = bStatus ? '0' : 'F';
-  sReturn[nReturnPos++] = bStatus ? 'F' : '0';
-
-  sReturn[nReturnPos] = '\0';
-  return sReturn;
-}
-
-/**
- * Encoding for type B switches with two rotary/sliding switches.
- *
- * The code word is a tristate word and with following bit pattern:
- *
- * +-----------------------------+-----------------------------+----------+------------+
- * | 4 bits address              | 4 bits address              | 3 bits   | 1 bit      |
- * | switch group                | switch number               | not used | on / off   |
- * | 1=0FFF 2=F0FF 3=FF0F 4=FFF0 | 1=0FFF 2=F0FF 3=FF0F 4=FFF0 | FFF      | on=F off=0 |
- * +-----------------------------+-----------------------------+----------+------------+
- *
- * @param nAddressCode  Number of the switch group (1..4)
- * @param nChannelCode  Number of the switch itself (1..4)
- * @param bStatus       Whether to switch on (true) or off (false)
- *
- * @return char[13], representing a tristate code word of length 12
- */
-char* RCSwitch::getCodeWordB(int nAddressCode, int nChannelCode, bool bStatus) {
-  static char sReturn[13];
-  int nReturnPos = 0;
-
-  if (nAddressCode < 1 || nAddressCode > 4 || nChannelCode < 1 || nChannelCode > 4) {
-    return 0;
-  }
-
-  for (int i = 1; i <= 4; i++) {
-    sReturn[nReturnPos++] = (nAddressCode == i) ? '0' : 'F';
-  }
-
-  for (int i = 1; i <= 4; i++) {
-    sReturn[nReturnPos++] = (nChannelCode == i) ? '0' : 'F';
-  }
-
-  sReturn[nReturnPos++] = 'F';
-  sReturn[nReturnPos++] = 'F';
-  sReturn[nReturnPos++] = 'F';
-
-  sReturn[nReturnPos++] = bStatus ? 'F' : '0';
-
-  sReturn[nReturnPos] = '\0';
-  return sReturn;
+  this->send(codeWordA(sGroup, sDevice, false));
 }
 
-/**
- * Like getCodeWord (Type C = Intertechno)
- */
-char* RCSwitch::getCodeWordC(char sFamily, int nGroup, int nDevice, bool bStatus) {
-  static char sReturn[13];
-  int nReturnPos = 0;
-
-  int nFamily = (int)sFamily - 'a';
-  if ( nFamily < 0 || nFamily > 15 || nGroup < 1 || nGroup > 4 || nDevice < 1 || nDevice > 4) {
-    return 0;
-  }
-  
-  // encode the family into four bits
-  sReturn[nReturnPos++] = (nFamily & 1) ? 'F' : '0';
-  sReturn[nReturnPos++] = (nFamily & 2) ? 'F' : '0';
-  sReturn[nReturnPos++] = (nFamily & 4) ? 'F' : '0';
-  sReturn[nReturnPos++] = (nFamily & 8) ? 'F' : '0';
-
-  // encode the device and group
-  sReturn[nReturnPos++] = ((nDevice-1) & 1) ? 'F' : '0';
-  sReturn[nReturnPos++] = ((nDevice-1) & 2) ? 'F' : '0';
-  sReturn[nReturnPos++] = ((nGroup-1) & 1) ? 'F' : '0';
-  sReturn[nReturnPos++] = ((nGroup-1) & 2) ? 'F' : '0';
-
-  // encode the status code
-  sReturn[nReturnPos++] = '0';
-  sReturn[nReturnPos++] = 'F';
-  sReturn[nReturnPos++] = 'F';
-  sReturn[nReturnPos++] = bStatus ? 'F' : '0';
-
-  sReturn[nReturnPos] = '\0';
-  return sReturn;
-}
-
-/**
- * Encoding for the REV Switch Type
- *
- * The code word is a tristate word and with following bit pattern:
- *
- * +-----------------------------+-------------------+----------+--------------+
- * | 4 bits address              | 3 bits address    | 3 bits   | 2 bits       |
- * | switch group                | device number     | not used | on / off     |
- * | A=1FFF B=F1FF C=FF1F D=FFF1 | 1=0FF 2=F0F 3=FF0 | 000      | on=10 off=01 |
- * +-----------------------------+-------------------+----------+--------------+
- *
- * Source: http://www.the-intruder.net/funksteckdosen-von-rev-uber-arduino-ansteuern/
- *
- * @param sGroup        Name of the switch group (A..D, resp. a..d) 
- * @param nDevice       Number of the switch itself (1..3)
- * @param bStatus       Whether to switch on (true) or off (false)
- *
- * @return char[13], representing a tristate code word of length 12
- */
-char* RCSwitch::getCodeWordD(char sGroup, int nDevice, bool bStatus) {
-  static char sReturn[13];
-  int nReturnPos = 0;
-
-  // sGroup must be one of the letters in "abcdABCD"
-  int nGroup = (sGroup >= 'a') ? (int)sGroup - 'a' : (int)sGroup - 'A';
-  if ( nGroup < 0 || nGroup > 3 || nDevice < 1 || nDevice > 3) {
-    return 0;
-  }
-
-  for (int i = 0; i < 4; i++) {
-    sReturn[nReturnPos++] = (nGroup == i) ? '1' : 'F';
-  }
-
-  for (int i = 1; i <= 3; i++) {
-    sReturn[nReturnPos++] = (nDevice == i) ? '1' : 'F';
-  }
-
-  sReturn[nReturnPos++] = '0';
-  sReturn[nReturnPos++] = '0';
-  sReturn[nReturnPos++] = '0';
-
-  sReturn[nReturnPos++] = bStatus ? '1' : '0';
-  sReturn[nReturnPos++] = bStatus ? '0' : '1';
-
-  sReturn[nReturnPos] = '\0';
-  return sReturn;
-}
 
 /**
  * @param sCodeWord   a tristate code word consisting of the letter 0, 1, F
  */
 void RCSwitch::sendTriState(const char* sCodeWord) {
   // turn the tristate code word into the corresponding bit pattern, then send it
-  unsigned long code = 0;
+  Code code = 0;
   unsigned int length = 0;
   for (const char* p = sCodeWord; *p; p++) {
-    code <<= 2L;
+    code <<= 2;
     switch (*p) {
       case '0':
         // bit pattern 00
         break;
       case 'F':
         // bit pattern 01
-        code |= 1L;
+        code |= 1;
         break;
       case '1':
         // bit pattern 11
-        code |= 3L;
+        code |= 3;
         break;
     }
     length += 2;
@@ -479,26 +541,41 @@ void RCSwitch::sendTriState(const char* sCodeWord) {
  */
 void RCSwitch::send(const char* sCodeWord) {
   // turn the tristate code word into the corresponding bit pattern, then send it
-  unsigned long code = 0;
+  Code code = 0;
   unsigned int length = 0;
   for (const char* p = sCodeWord; *p; p++) {
-    code <<= 1L;
+    code <<= 1;
     if (*p != '0')
-      code |= 1L;
+      code |= 1;
     length++;
   }
   this->send(code, length);
 }
 
+/**
+ * Transmit a code word, e.g. one built by codeWordA() .. codeWordD(). Does
+ * nothing for an invalid (zero length) code word.
+ */
+void RCSwitch::send(CodeWord word) {
+  if (word.length != 0) {
+    this->send(word.code, word.length);
+  }
+}
+
 /**
  * Transmit the first 'length' bits of the integer 'code'. The
  * bits are sent from MSB to LSB, i.e., first the bit at position length-1,
  * then the bit at position length-2, and so on, till finally the bit at position 0.
  */
-void RCSwitch::send(unsigned long code, unsigned int length) {
+void RCSwitch::send(Code code, unsigned int length) {
   if (this->nTransmitterPin == -1)
     return;
 
+  // let an asynchronous transmission finish first, it owns the pin
+  while (RCSwitch::bTransmitting) {
+    delayMicroseconds(100);
+  }
+
 #if not defined( RCSwitchDisableReceiving )
   // make sure the receiver is disabled while we transmit
   int nReceiverInterrupt_backup = nReceiverInterrupt;
@@ -509,7 +586,7 @@ void RCSwitch::send(unsigned long code, unsigned int length) {
 
   for (int nRepeat = 0; nRepeat < nRepeatTransmit; nRepeat++) {
     for (int i = length-1; i >= 0; i--) {
-      if (code & (1L << i))
+      if (code & ((Code)1 << i))
         this->transmit(protocol.one);
       else
         this->transmit(protocol.zero);
@@ -541,8 +618,131 @@ void RCSwitch::transmit(HighLow pulses) {
   delayMicroseconds( this->protocol.pulseLength * pulses.low);
 }
 
+/**
+ * Like send(), but returns right away: the code is compiled into a buffer of
+ * pulse durations which a timer interrupt plays back, nRepeatTransmit times.
+ * The receiver stays enabled and ignores what it hears until the
+ * transmission is over.
+ *
+ * Without a timer on this platform the code is sent synchronously.
+ *
+ * @return false if no transmitter is enabled, the code is too long, or a
+ *         transmission is still in progress
+ */
+bool RCSwitch::sendAsync(Code code, unsigned int length) {
+  if (this->nTransmitterPin == -1 || length > RCSWITCH_MAX_BITS ||
+      this->nRepeatTransmit < 1 || RCSwitch::bTransmitting) {
+    return false;
+  }
+
+  unsigned int n = 0;
+  for (int i = length-1; i >= 0; i--) {
+    const HighLow &pulses = (code & ((Code)1 << i)) ? protocol.one : protocol.zero;
+    RCSwitch::txPulses[n++] = this->protocol.pulseLength * pulses.high;
+    RCSwitch::txPulses[n++] = this->protocol.pulseLength * pulses.low;
+  }
+  RCSwitch::txPulses[n++] = this->protocol.pulseLength * protocol.syncFactor.high;
+  RCSwitch::txPulses[n++] = this->protocol.pulseLength * protocol.syncFactor.low;
+
+  RCSwitch::nTxCount = n;
+  RCSwitch::nTxIndex = 0;
+  RCSwitch::nTxRepeats = this->nRepeatTransmit;
+  RCSwitch::nTxPin = this->nTransmitterPin;
+  RCSwitch::bTxInverted = this->protocol.invertedSignal;
+  RCSwitch::bTransmitDone = false;
+  RCSwitch::bTransmitting = true;
+
+#if defined(RCSWITCH_TX_TIMER)
+  TX_TIMER_BEGIN(RCSwitch::transmitStep);
+  RCSwitch::transmitStep();
+#else
+  for (RCSwitch::transmitStep(); RCSwitch::bTransmitting; RCSwitch::transmitStep()) {
+    delayMicroseconds(RCSwitch::txPulses[RCSwitch::nTxIndex - 1]);
+  }
+#endif
+  return true;
+}
+
+/**
+ * Whether an asynchronous transmission is in progress. Calls the completion
+ * callback, from the caller's context, once the transmission has ended.
+ */
+bool RCSwitch::isTransmitting() {
+  if (RCSwitch::bTransmitDone) {
+    RCSwitch::bTransmitDone = false;
+    if (RCSwitch::txCallback) {
+      RCSwitch::txCallback();
+    }
+  }
+  return RCSwitch::bTransmitting;
+}
+
+/**
+ * Sets a function to call when an asynchronous transmission has ended. It is
+ * not called from the interrupt, but by the next isTransmitting(). Pass 0 to
+ * remove it.
+ */
+void RCSwitch::onTransmitComplete(void (*callback)(void)) {
+  RCSwitch::txCallback = callback;
+}
+
+/**
+ * Sets the level for the next pulse of the asynchronous transmission and
+ * arms the timer for its duration, or ends the transmission after the last
+ * repeat.
+ */
+void RECEIVE_ATTR RCSwitch::transmitStep() {
+  unsigned int i = RCSwitch::nTxIndex;
+  if (i == RCSwitch::nTxCount) {
+    if (--RCSwitch::nTxRepeats == 0) {
+      // leave the transmitter off, as send() does
+      digitalWrite(RCSwitch::nTxPin, LOW);
+#if defined(RCSWITCH_TX_TIMER)
+      TX_TIMER_END();
+#endif
+      RCSwitch::bTransmitting = false;
+      RCSwitch::bTransmitDone = true;
+      return;
+    }
+    i = 0;
+  }
+  // even entries are the first logic level of a pulse, odd ones the second
+  const bool high = ((i & 1) == 0) != RCSwitch::bTxInverted;
+  digitalWrite(RCSwitch::nTxPin, high ? HIGH : LOW);
+#if defined(RCSWITCH_TX_TIMER)
+  TX_TIMER_ARM(RCSwitch::txPulses[i]);
+#endif
+  RCSwitch::nTxIndex = i + 1;
+}
+
 
 #if not defined( RCSwitchDisableReceiving )
+/**
+ * Interrupt entry point of receiver slot nSlot: passes the edge on to the
+ * instance using that slot.
+ */
+template <int nSlot>
+void RECEIVE_ATTR RCSwitch::handleInterruptSlot() {
+  RCSwitch* receiver = RCSwitch::receivers[nSlot];
+  if (receiver) {
+    receiver->handleInterrupt();
+  }
+}
+
+/**
+ * The interrupt entry point of a receiver slot, for attachInterrupt().
+ * Instantiates one handleInterruptSlot() per slot from nSlot up.
+ */
+template <>
+RCSwitch::InterruptHandler RCSwitch::interruptHandlerFor<RCSWITCH_MAX_RECEIVERS>(int) {
+  return 0;
+}
+
+template <int nSlot>
+RCSwitch::InterruptHandler RCSwitch::interruptHandlerFor(int slot) {
+  return (slot == nSlot) ? handleInterruptSlot<nSlot> : interruptHandlerFor<nSlot + 1>(slot);
+}
+
 /**
  * Enable receiving data
  */
@@ -553,12 +753,29 @@ void RCSwitch::enableReceive(int interrupt) {
 
 void RCSwitch::enableReceive() {
   if (this->nReceiverInterrupt != -1) {
-    RCSwitch::nReceivedValue = 0;
-    RCSwitch::nReceivedBitlength = 0;
+    if (this->nReceiverSlot == -1) {
+      for (int i = 0; i < RCSWITCH_MAX_RECEIVERS; i++) {
+        if (RCSwitch::receivers[i] == 0) {
+          this->nReceiverSlot = i;
+          break;
+        }
+      }
+      if (this->nReceiverSlot == -1) {
+        // all RCSWITCH_MAX_RECEIVERS slots taken
+        return;
+      }
+    }
+    // Frames waiting to be read, queued or (deferred mode) captured, are
+    // kept: send() comes through here after every transmission. Only the
+    // frame that was being captured is given up.
+    this->nChangeCount = 0;
+    this->nRepeatCount = 0;
+    this->bReceiverMasked = false;
+    RCSwitch::receivers[this->nReceiverSlot] = this;
 #if defined(RaspberryPi) // Raspberry Pi
-    wiringPiISR(this->nReceiverInterrupt, INT_EDGE_BOTH, &handleInterrupt);
+    wiringPiISR(this->nReceiverInterrupt, INT_EDGE_BOTH, interruptHandlerFor<0>(this->nReceiverSlot));
 #else // Arduino
-    attachInterrupt(this->nReceiverInterrupt, handleInterrupt, CHANGE);
+    attachInterrupt(this->nReceiverInterrupt, interruptHandlerFor<0>(this->nReceiverSlot), CHANGE);
 #endif
   }
 }
@@ -571,58 +788,260 @@ void RCSwitch::disableReceive() {
   detachInterrupt(this->nReceiverInterrupt);
 #endif // For Raspberry Pi (wiringPi) you can't unregister the ISR
   this->nReceiverInterrupt = -1;
+  if (this->nReceiverSlot != -1) {
+    // the slot's trampoline now finds nobody to dispatch to
+    RCSwitch::receivers[this->nReceiverSlot] = 0;
+    this->nReceiverSlot = -1;
+  }
+}
+
+
+/**
+ * Stops receive interrupts from the interrupt handler itself, see
+ * setEdgeRateLimit(). The handler ignores edges while bReceiverMasked is
+ * set, which is all that can be done where the interrupt cannot be
+ * switched off from within.
+ */
+void RECEIVE_ATTR RCSwitch::maskReceiver() {
+  this->bReceiverMasked = true;
+  this->nMaskedSince = micros();
+  this->nRateLimitCount = this->nRateLimitCount + 1;
+#if defined(ESP8266)
+  // what detachInterrupt() does, but safe to run from RAM: clear the
+  // pin's interrupt type (the interrupt number is the GPIO number)
+  GPC(this->nReceiverInterrupt) &= ~(0xF << GPCI);
+#elif not defined(RaspberryPi)
+  detachInterrupt(this->nReceiverInterrupt);
+#endif
+}
+
+/**
+ * Re-enables the receive interrupt once the mask time of the edge rate
+ * limit has passed.
+ */
+void RCSwitch::unmaskReceiver() {
+  if (this->bReceiverMasked && this->nReceiverInterrupt != -1 &&
+      micros() - this->nMaskedSince >= this->nMaskDuration) {
+#if not defined(RaspberryPi)
+    attachInterrupt(this->nReceiverInterrupt, interruptHandlerFor<0>(this->nReceiverSlot), CHANGE);
+#endif
+    this->bReceiverMasked = false;
+  }
 }
 
 bool RCSwitch::available() {
-  return RCSwitch::nReceivedValue != 0;
+  this->unmaskReceiver();
+  if (this->bDeferredDecoding) {
+    this->decodePending();
+  }
+  return this->nRxHead != this->nRxTail;
 }
 
+/**
+ * Drops the oldest queued frame, making the next one (if any) current.
+ */
 void RCSwitch::resetAvailable() {
-  RCSwitch::nReceivedValue = 0;
+  if (this->available()) {
+    RCSWITCH_BARRIER();
+    this->nRxTail = this->nRxTail + 1;
+  }
 }
 
-unsigned long RCSwitch::getReceivedValue() {
-  return RCSwitch::nReceivedValue;
+RCSwitch::Code RCSwitch::getReceivedValue() {
+  if (!this->available()) {
+    return 0;
+  }
+  return this->rxQueue[this->nRxTail & (RCSWITCH_RX_QUEUE_SIZE - 1)].value;
 }
 
 unsigned int RCSwitch::getReceivedBitlength() {
-  return RCSwitch::nReceivedBitlength;
+  return this->rxQueue[this->nRxTail & (RCSWITCH_RX_QUEUE_SIZE - 1)].bitlength;
 }
 
 unsigned int RCSwitch::getReceivedDelay() {
-  return RCSwitch::nReceivedDelay;
+  return this->rxQueue[this->nRxTail & (RCSWITCH_RX_QUEUE_SIZE - 1)].delay;
 }
 
 unsigned int RCSwitch::getReceivedProtocol() {
-  return RCSwitch::nReceivedProtocol;
+  return this->rxQueue[this->nRxTail & (RCSWITCH_RX_QUEUE_SIZE - 1)].protocol;
+}
+
+/**
+ * Pops the oldest queued frame.
+ *
+ * @return false if no frame was pending
+ */
+bool RCSwitch::readFrame(ReceivedFrame &frame) {
+  if (!this->available()) {
+    return false;
+  }
+  RCSWITCH_BARRIER();
+  frame = this->rxQueue[this->nRxTail & (RCSWITCH_RX_QUEUE_SIZE - 1)];
+  RCSWITCH_BARRIER();
+  this->nRxTail = this->nRxTail + 1;
+  return true;
+}
+
+/**
+ * Pops up to nMaxFrames queued frames, oldest first.
+ *
+ * @return number of frames copied to frames
+ */
+unsigned int RCSwitch::drainFrames(ReceivedFrame* frames, unsigned int nMaxFrames) {
+  unsigned int n = 0;
+  while (n < nMaxFrames && this->readFrame(frames[n])) {
+    n++;
+  }
+  return n;
+}
+
+unsigned int RCSwitch::getPendingFrames() {
+  return (uint8_t)(this->nRxHead - this->nRxTail);
+}
+
+/**
+ * Number of decoded frames dropped because the queue was full.
+ */
+unsigned int RCSwitch::getOverflowCount() {
+  return this->nRxOverflow;
+}
+
+void RCSwitch::resetOverflowCount() {
+  this->nRxOverflow = 0;
 }
 
 unsigned int* RCSwitch::getReceivedRawdata() {
-  return RCSwitch::timings;
+  if (this->bDeferredDecoding) {
+    return this->timings[this->nCaptureBuffer ^ 1];
+  }
+  return this->timings[this->nCaptureBuffer];
 }
 
-/* helper function for the receiveProtocol method */
+/**
+ * Decodes the frame captured by the interrupt handler in deferred mode, if
+ * one is waiting, and queues the result.
+ *
+ * @return true if a frame was decoded
+ */
+bool RCSwitch::decodePending() {
+  const unsigned int changeCount = this->nPendingChanges;
+  if (changeCount == 0) {
+    return false;
+  }
+  RCSWITCH_BARRIER();
+  // The handler does not flip buffers while a frame is pending
+  const bool decoded = decodeFrame(this->timings[this->nCaptureBuffer ^ 1], changeCount, this->nPendingTime);
+  RCSWITCH_BARRIER();
+  this->nPendingChanges = 0;
+  return decoded;
+}
+
+/**
+ * Number of complete frames discarded in deferred mode because the previous
+ * one had not been decoded yet.
+ */
+unsigned int RCSwitch::getCaptureOverrunCount() {
+  return this->nCaptureOverrun;
+}
+
+/**
+ * Appends a decoded frame to the receive queue. Called, through
+ * deliverFrame(), from the interrupt handler or from decodePending() in
+ * deferred mode, never both; when the queue is full the new frame is
+ * dropped and counted.
+ */
+void RECEIVE_ATTR RCSwitch::queueFrame(Code value, unsigned int bitlength, unsigned int delay, unsigned int protocol, unsigned long timestamp, uint8_t flags) {
+  const uint8_t head = this->nRxHead;
+  if ((uint8_t)(head - this->nRxTail) >= RCSWITCH_RX_QUEUE_SIZE) {
+    this->nRxOverflow = this->nRxOverflow + 1;
+    return;
+  }
+  ReceivedFrame &frame = this->rxQueue[head & (RCSWITCH_RX_QUEUE_SIZE - 1)];
+  frame.value = value;
+  frame.bitlength = bitlength;
+  frame.delay = delay;
+  frame.protocol = protocol;
+  frame.timestamp = timestamp;
+  frame.flags = flags;
+  RCSWITCH_BARRIER();
+  this->nRxHead = head + 1;
+}
+
+/**
+ * Passes a decoded frame on to the queue. Outside low latency mode every
+ * frame has been seen twice already and is queued as confirmed; in low
+ * latency mode the first frame of a transmission is queued unconfirmed,
+ * then the verdict of its repeats, then one agreeing repeat per
+ * RCSWITCH_HOLD_INTERVAL for as long as the sender keeps repeating.
+ */
+void RECEIVE_ATTR RCSwitch::deliverFrame(Code value, unsigned int bitlength, unsigned int delay, unsigned int protocol, unsigned long timestamp) {
+  this->nLastFrameTime = timestamp;
+  if (!this->bLowLatency) {
+    queueFrame(value, bitlength, delay, protocol, timestamp, RCSWITCH_FRAME_CONFIRMED);
+    return;
+  }
+
+  if (this->llState != 0 && timestamp - this->llLastTime > RCSWITCH_REPEAT_TIMEOUT) {
+    // previous transmission is over
+    this->llState = 0;
+  }
+  this->llLastTime = timestamp;
+
+  if (this->llState != 0 && (value != this->llCode || protocol != this->llProtocol)) {
+    // retract what was delivered, then start over with the new frame
+    queueFrame(this->llCode, this->llBitlength, this->llDelay, this->llProtocol, timestamp,
+               RCSWITCH_FRAME_REPEAT | RCSWITCH_FRAME_CANCELLED);
+    this->llState = 0;
+  }
+
+  if (this->llState == 0) {
+    queueFrame(value, bitlength, delay, protocol, timestamp, 0);
+    this->llCode = value;
+    this->llBitlength = bitlength;
+    this->llDelay = delay;
+    this->llProtocol = protocol;
+    this->llState = 1;
+  } else if (this->llState == 1 || timestamp - this->llDelivered >= RCSWITCH_HOLD_INTERVAL) {
+    // confirmation, then a held button keeps reporting at a bounded rate
+    queueFrame(value, bitlength, delay, protocol, timestamp,
+               RCSWITCH_FRAME_REPEAT | RCSWITCH_FRAME_CONFIRMED);
+    this->llState = 2;
+  } else {
+    return;
+  }
+  this->llDelivered = timestamp;
+}
+
+/* helper function for the handleInterrupt method */
 static inline unsigned int diff(int A, int B) {
   return abs(A - B);
 }
 
 /**
- *
+ * Builds the per-protocol receive constants. Everything in here depends only
+ * on proto[], so it is computed once for all instances rather than for
+ * every protocol of every received frame.
  */
-bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCount) {
+void RCSwitch::buildMatchTables() {
+  RCSwitch::nRatioIndexSize[0] = 0;
+  RCSwitch::nRatioIndexSize[1] = 0;
+
+  for (unsigned int p = 0; p < numProto; p++) {
 #if defined(ESP8266) || defined(ESP32)
-    const Protocol &pro = proto[p-1];
+    const Protocol &pro = proto[p];
 #else
     Protocol pro;
-    memcpy_P(&pro, &proto[p-1], sizeof(Protocol));
+    memcpy_P(&pro, &proto[p], sizeof(Protocol));
 #endif
-
-    unsigned long code = 0;
+    ProtocolMatch &m = RCSwitch::protoMatch[p];
     //Assuming the longer pulse length is the pulse captured in timings[0]
     const unsigned int syncLengthInPulses =  ((pro.syncFactor.low) > (pro.syncFactor.high)) ? (pro.syncFactor.low) : (pro.syncFactor.high);
-    const unsigned int delay = RCSwitch::timings[0] / syncLengthInPulses;
-    const unsigned int delayTolerance = delay * RCSwitch::nReceiveTolerance / 100;
-    
+    m.syncLength = syncLengthInPulses;
+    // rounded up, so that for any sync up to 0xFFFF, (sync * syncReciprocal) >> 16
+    // is sync / syncLengthInPulses or one more; receiveProtocol() corrects that
+    m.syncReciprocal = (65536UL + syncLengthInPulses - 1) / syncLengthInPulses;
+    m.zero = pro.zero;
+    m.one = pro.one;
     /* For protocols that start low, the sync period looks like
      *               _________
      * _____________|         |XXXXXXXXXXXX|
@@ -640,15 +1059,71 @@ bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCoun
      *
      * The 2nd saved duration starts the data
      */
-    const unsigned int firstDataTiming = (pro.invertedSignal) ? (2) : (1);
+    m.firstDataTiming = (pro.invertedSignal) ? (2) : (1);
+
+    // zero and one bits may differ in total length (e.g. protocol 8)
+    const uint32_t zeroPulses = pro.zero.high + pro.zero.low;
+    const uint32_t onePulses = pro.one.high + pro.one.low;
+    const uint32_t minPulses = (zeroPulses < onePulses) ? zeroPulses : onePulses;
+    const uint32_t maxPulses = (zeroPulses < onePulses) ? onePulses : zeroPulses;
+    const uint32_t sync16 = (uint32_t)syncLengthInPulses << 4;
+    m.ratioMin = sync16 * (100 - RCSWITCH_SYNC_RATIO_TOLERANCE) / (100 * maxPulses);
+    m.ratioMax = sync16 * (100 + RCSWITCH_SYNC_RATIO_TOLERANCE) / (100 * minPulses);
+    m.ratioCenter = 2 * sync16 / (minPulses + maxPulses);
+    m.ratioZero = sync16 / zeroPulses;
+    m.ratioOne = sync16 / onePulses;
+
+    // insertion sort by ratioCenter; equal ratios stay in protocol order
+    uint8_t* index = RCSwitch::ratioIndex[m.firstDataTiming - 1];
+    uint8_t n = RCSwitch::nRatioIndexSize[m.firstDataTiming - 1]++;
+    while (n > 0 && RCSwitch::protoMatch[index[n - 1] - 1].ratioCenter > m.ratioCenter) {
+      index[n] = index[n - 1];
+      n--;
+    }
+    index[n] = p + 1;
+  }
+  RCSwitch::bMatchTablesBuilt = true;
+}
+
+/**
+ * Sets w to the range of durations within the receive tolerance of
+ * 'expected', i.e. those with diff(duration, expected) < tolerance.
+ */
+static inline void RECEIVE_ATTR setWindow(RCSwitch::PulseWindow &w, uint32_t expected, uint32_t tolerance) {
+  w.min = (expected >= tolerance) ? expected - tolerance + 1 : 0;
+  w.max = expected + tolerance - 1;
+}
+
+static inline bool RECEIVE_ATTR inWindow(const RCSwitch::PulseWindow &w, uint32_t duration) {
+  return duration >= w.min && duration <= w.max;
+}
+
+/**
+ * delay * nReceiveTolerance / 100 without the division. nToleranceScale is
+ * rounded up, so the product is exact or one too high for any delay up to
+ * 0xFFFF.
+ */
+uint32_t RECEIVE_ATTR RCSwitch::toleranceOf(uint32_t delay) const {
+  uint32_t tolerance = (delay * this->nToleranceScale) >> 16;
+  if (tolerance * 100 > delay * this->nReceiveTolerance) {
+    tolerance--;
+  }
+  return tolerance;
+}
 
-    for (unsigned int i = firstDataTiming; i < changeCount - 1; i += 2) {
+/**
+ * Decodes the data bits of a frame with the given acceptance windows,
+ * giving up on the first pair of timings that fits neither bit value.
+ *
+ * @param w   windows for zero high, zero low, one high and one low
+ */
+bool RECEIVE_ATTR RCSwitch::matchBits(const ProtocolMatch &m, const PulseWindow* w, const unsigned int* raw, unsigned int changeCount, Code &code) {
+    code = 0;
+    for (unsigned int i = m.firstDataTiming; i < changeCount - 1; i += 2) {
         code <<= 1;
-        if (diff(RCSwitch::timings[i], delay * pro.zero.high) < delayTolerance &&
-            diff(RCSwitch::timings[i + 1], delay * pro.zero.low) < delayTolerance) {
+        if (inWindow(w[0], raw[i]) && inWindow(w[1], raw[i + 1])) {
             // zero
-        } else if (diff(RCSwitch::timings[i], delay * pro.one.high) < delayTolerance &&
-                   diff(RCSwitch::timings[i + 1], delay * pro.one.low) < delayTolerance) {
+        } else if (inWindow(w[2], raw[i]) && inWindow(w[3], raw[i + 1])) {
             // one
             code |= 1;
         } else {
@@ -656,31 +1131,342 @@ bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, unsigned int changeCoun
             return false;
         }
     }
+    return true;
+}
+
+/**
+ * Decodes a frame as protocol p, deriving the pulse length from the sync
+ * and accepting nReceiveTolerance percent of deviation.
+ */
+bool RECEIVE_ATTR RCSwitch::receiveProtocol(const int p, const unsigned int* raw, unsigned int changeCount, Code &code, unsigned int &delay) {
+    // decodeFrame() has already rejected frames of 7 changes or less (no
+    // device sends them, so they must be noise) and sync timings that would
+    // overflow the reciprocal below
+    const ProtocolMatch &m = RCSwitch::protoMatch[p-1];
+    const uint32_t sync = raw[0];
+    delay = (sync * m.syncReciprocal) >> 16;
+    if (delay * m.syncLength > sync) {
+      delay--;
+    }
+    const uint32_t delayTolerance = toleranceOf(delay);
+    if (delayTolerance == 0) {
+        return false;
+    }
+
+    PulseWindow w[4];
+    setWindow(w[0], delay * m.zero.high, delayTolerance);
+    setWindow(w[1], delay * m.zero.low, delayTolerance);
+    setWindow(w[2], delay * m.one.high, delayTolerance);
+    setWindow(w[3], delay * m.one.low, delayTolerance);
+    return matchBits(m, w, raw, changeCount, code);
+}
+
+/**
+ * Tries the learned sender whose sync length best fits this frame, with
+ * windows just wide enough for that sender's own jitter.
+ *
+ * @return index of the sender profile that decoded the frame, or -1
+ */
+int RECEIVE_ATTR RCSwitch::receiveCalibrated(const unsigned int* raw, unsigned int changeCount, Code &code, unsigned int &delay) {
+  int best = -1;
+  uint32_t bestDeviation = 0;
+  for (int i = 0; i < RCSWITCH_MAX_SENDERS; i++) {
+    const SenderProfile &sender = this->senders[i];
+    if (sender.samples < RCSWITCH_SENDER_MIN_SAMPLES) {
+      continue;
+    }
+    const uint32_t expected = (sender.pulse16 * RCSwitch::protoMatch[sender.protocol - 1].syncLength) >> 4;
+    const uint32_t deviation = (raw[0] > expected) ? raw[0] - expected : expected - raw[0];
+    // the gap also absorbs slow drift, so allow it a little more than the data
+    if (deviation <= (expected >> 4) + ((RCSWITCH_SENDER_JITTER_FACTOR * sender.jitter16) >> 4) &&
+        (best < 0 || deviation < bestDeviation)) {
+      best = i;
+      bestDeviation = deviation;
+    }
+  }
+  if (best < 0) {
+    return -1;
+  }
+
+  const SenderProfile &sender = this->senders[best];
+  const ProtocolMatch &m = RCSwitch::protoMatch[sender.protocol - 1];
+  delay = sender.pulse16 >> 4;
+  uint32_t tolerance = ((RCSWITCH_SENDER_JITTER_FACTOR * sender.jitter16) >> 4) + RCSWITCH_SENDER_MIN_TOLERANCE;
+  const uint32_t wide = toleranceOf(delay);
+  if (tolerance > wide) {
+    tolerance = wide;
+  }
+
+  PulseWindow w[4];
+  setWindow(w[0], (sender.pulse16 * m.zero.high) >> 4, tolerance);
+  setWindow(w[1], (sender.pulse16 * m.zero.low) >> 4, tolerance);
+  setWindow(w[2], (sender.pulse16 * m.one.high) >> 4, tolerance);
+  setWindow(w[3], (sender.pulse16 * m.one.low) >> 4, tolerance);
+  return matchBits(m, w, raw, changeCount, code) ? best : -1;
+}
+
+/**
+ * Updates the pulse length and jitter learned for the sender of a decoded
+ * frame, creating its profile (in place of the one heard from longest ago)
+ * if needed.
+ *
+ * The pulse length is measured over all data timings, which is far more
+ * precise than deriving it from the sync alone; the jitter is the largest
+ * deviation of a single timing from its nominal length. Both are smoothed
+ * exponentially, the jitter rising fast and decaying slowly.
+ *
+ * @param slot   profile that decoded the frame, or -1
+ */
+void RECEIVE_ATTR RCSwitch::learnSender(int slot, int p, Code code, const unsigned int* raw, unsigned int changeCount, unsigned long timestamp) {
+  const ProtocolMatch &m = RCSwitch::protoMatch[p-1];
+  const unsigned int nBits = (changeCount - m.firstDataTiming) / 2;
+  if (nBits == 0) {
+    return;
+  }
+
+  uint32_t total = 0;
+  uint32_t pulses = 0;
+  for (unsigned int b = 0; b < nBits; b++) {
+    const unsigned int i = m.firstDataTiming + 2 * b;
+    const HighLow &bit = ((code >> (nBits - 1 - b)) & 1) ? m.one : m.zero;
+    total += raw[i] + raw[i + 1];
+    pulses += bit.high + bit.low;
+  }
+  const uint32_t pulse16 = (total << 4) / pulses;
+
+  uint32_t jitter16 = 0;
+  for (unsigned int b = 0; b < nBits; b++) {
+    const unsigned int i = m.firstDataTiming + 2 * b;
+    const HighLow &bit = ((code >> (nBits - 1 - b)) & 1) ? m.one : m.zero;
+    const uint32_t high16 = pulse16 * bit.high;
+    const uint32_t low16 = pulse16 * bit.low;
+    const uint32_t dHigh = (raw[i] << 4 > high16) ? (raw[i] << 4) - high16 : high16 - (raw[i] << 4);
+    const uint32_t dLow = (raw[i + 1] << 4 > low16) ? (raw[i + 1] << 4) - low16 : low16 - (raw[i + 1] << 4);
+    if (dHigh > jitter16) {
+      jitter16 = dHigh;
+    }
+    if (dLow > jitter16) {
+      jitter16 = dLow;
+    }
+  }
 
-    if (changeCount > 7) {    // ignore very short transmissions: no device sends them, so this must be noise
-        RCSwitch::nReceivedValue = code;
-        RCSwitch::nReceivedBitlength = (changeCount - 1) / 2;
-        RCSwitch::nReceivedDelay = delay;
-        RCSwitch::nReceivedProtocol = p;
-        return true;
+  if (slot < 0 || this->senders[slot].code != code || this->senders[slot].protocol != p) {
+    slot = 0;
+    for (int i = 0; i < RCSWITCH_MAX_SENDERS; i++) {
+      const SenderProfile &sender = this->senders[i];
+      if (sender.protocol == p && sender.code == code) {
+        slot = i;
+        break;
+      }
+      if (sender.samples == 0 ||
+          (this->senders[slot].samples != 0 &&
+           (long)(sender.lastSeen - this->senders[slot].lastSeen) < 0)) {
+        slot = i;
+      }
     }
+  }
 
+  SenderProfile &sender = this->senders[slot];
+  if (sender.samples == 0 || sender.protocol != p || sender.code != code) {
+    sender.code = code;
+    sender.protocol = p;
+    sender.samples = 0;
+    sender.pulse16 = pulse16;
+    // start out generous, so a few frames are needed to earn a tight window
+    sender.jitter16 = jitter16 + (pulse16 >> 3);
+  } else {
+    sender.pulse16 = sender.pulse16 - (sender.pulse16 >> 3) + (pulse16 >> 3);
+    if (jitter16 > sender.jitter16) {
+      sender.jitter16 = (sender.jitter16 + jitter16) >> 1;
+    } else {
+      sender.jitter16 = sender.jitter16 - (sender.jitter16 >> 4) + (jitter16 >> 4);
+    }
+  }
+  if (sender.samples < 255) {
+    sender.samples++;
+  }
+  sender.lastSeen = timestamp;
+}
+
+/**
+ * Matches a captured frame against the protocols it can plausibly be.
+ *
+ * The ratio of the sync duration to the duration of the first data bit does
+ * not depend on the sender's pulse length, so it identifies the protocol
+ * family without knowing the pulse length. For both sync layouts (data
+ * starting at raw[1] or at raw[2]) the RCSWITCH_MAX_CANDIDATES protocols
+ * with the nearest nominal ratio are looked up in ratioIndex; those within
+ * RCSWITCH_SYNC_RATIO_TOLERANCE are then tried, closest first. The cost per
+ * frame thus no longer grows with the number of protocols.
+ *
+ * With sender calibration enabled, the learned senders are tried before
+ * that, with their own tight windows.
+ */
+bool RECEIVE_ATTR RCSwitch::decodeFrame(const unsigned int* raw, unsigned int changeCount, unsigned long timestamp) {
+  if (changeCount <= 7) {
     return false;
+  }
+  const uint32_t sync = raw[0];
+  if (sync > 0xFFFF) {
+    return false;
+  }
+
+  Code code;
+  unsigned int delay;
+  if (this->bSenderCalibration) {
+    const int slot = receiveCalibrated(raw, changeCount, code, delay);
+    if (slot >= 0) {
+      const int p = this->senders[slot].protocol;
+      this->deliverFrame(code, (changeCount - 1) / 2, delay, p, timestamp);
+      this->nCalibratedCount = this->nCalibratedCount + 1;
+      learnSender(slot, p, code, raw, changeCount, timestamp);
+      return true;
+    }
+  }
+
+  uint8_t candidates[2 * RCSWITCH_MAX_CANDIDATES];
+  uint32_t distance[2 * RCSWITCH_MAX_CANDIDATES];
+  unsigned int nCandidates = 0;
+
+  for (unsigned int t = 0; t < 2; t++) {
+    const uint32_t bit = raw[t + 1] + raw[t + 2];
+    if (bit == 0) {
+      continue;
+    }
+    const uint32_t ratio = (sync << 4) / bit;
+    const uint8_t* index = RCSwitch::ratioIndex[t];
+    const int size = RCSwitch::nRatioIndexSize[t];
+
+    // first entry with ratioCenter >= ratio
+    int lo = 0;
+    int hi = size;
+    while (lo < hi) {
+      const int mid = (lo + hi) / 2;
+      if (RCSwitch::protoMatch[index[mid] - 1].ratioCenter < ratio) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+
+    // walk outwards from there, nearest first
+    int below = lo - 1;
+    int above = lo;
+    for (unsigned int picked = 0; picked < RCSWITCH_MAX_CANDIDATES && (below >= 0 || above < size); picked++) {
+      int next;
+      if (below < 0) {
+        next = above++;
+      } else if (above >= size) {
+        next = below--;
+      } else if (ratio - RCSwitch::protoMatch[index[below] - 1].ratioCenter <= RCSwitch::protoMatch[index[above] - 1].ratioCenter - ratio) {
+        next = below--;
+      } else {
+        next = above++;
+      }
+      const ProtocolMatch &m = RCSwitch::protoMatch[index[next] - 1];
+      if (ratio < m.ratioMin || ratio > m.ratioMax) {
+        continue;
+      }
+      // keep candidates ordered by relative distance to the nearer nominal
+      // ratio, d/c compared as d1*c2 < d2*c1, and by protocol number on ties
+      const uint32_t dZero = (ratio > m.ratioZero) ? ratio - m.ratioZero : m.ratioZero - ratio;
+      const uint32_t dOne = (ratio > m.ratioOne) ? ratio - m.ratioOne : m.ratioOne - ratio;
+      const uint32_t d = (dZero < dOne) ? dZero : dOne;
+      unsigned int n = nCandidates++;
+      while (n > 0) {
+        const uint32_t lhs = d * RCSwitch::protoMatch[candidates[n - 1] - 1].ratioCenter;
+        const uint32_t rhs = distance[n - 1] * m.ratioCenter;
+        if (lhs > rhs || (lhs == rhs && index[next] > candidates[n - 1])) {
+          break;
+        }
+        candidates[n] = candidates[n - 1];
+        distance[n] = distance[n - 1];
+        n--;
+      }
+      candidates[n] = index[next];
+      distance[n] = d;
+    }
+  }
+
+  for (unsigned int i = 0; i < nCandidates; i++) {
+    if (receiveProtocol(candidates[i], raw, changeCount, code, delay)) {
+      // receive succeeded for this protocol
+      this->deliverFrame(code, (changeCount - 1) / 2, delay, candidates[i], timestamp);
+      if (this->bSenderCalibration) {
+        learnSender(-1, candidates[i], code, raw, changeCount, timestamp);
+      }
+      return true;
+    }
+  }
+  return false;
 }
 
 void RECEIVE_ATTR RCSwitch::handleInterrupt() {
 
-  static unsigned int changeCount = 0;
-  static unsigned long lastTime = 0;
-  static unsigned int repeatCount = 0;
+  unsigned int &changeCount = this->nChangeCount;
+  unsigned long &lastTime = this->nLastTime;
+  unsigned int &repeatCount = this->nRepeatCount;
+  unsigned long &windowStart = this->nWindowStart;
+  unsigned int &windowEdges = this->nWindowEdges;
+
+  if (this->bReceiverMasked) {
+    return;
+  }
+
+  if (RCSwitch::bTransmitting) {
+    // our own transmitter drowns out everything else; time the next
+    // pulse from the last edge heard while it was on
+    lastTime = micros();
+    changeCount = 0;
+    repeatCount = 0;
+    return;
+  }
 
   const long time = micros();
   const unsigned int duration = time - lastTime;
+  unsigned int* timings = this->timings[this->nCaptureBuffer];
+
+  if (this->nMaxEdges != 0) {
+    if ((unsigned long)(time - windowStart) > this->nEdgeWindow) {
+      windowStart = time;
+      windowEdges = 0;
+    }
+    if (++windowEdges > this->nMaxEdges) {
+      // whatever was being recorded is noise; start over once unmasked
+      maskReceiver();
+      changeCount = 0;
+      repeatCount = 0;
+      windowEdges = 0;
+      return;
+    }
+  }
+
+  if (duration < this->nMinPulse) {
+    this->nGlitchCount = this->nGlitchCount + 1;
+    if (changeCount >= 2) {
+      // The edge that started this spike ended a pulse that in fact goes
+      // on: drop it again and measure that pulse from its real start, so
+      // the next edge records it with the spike folded in.
+      changeCount--;
+      lastTime -= timings[changeCount];
+    }
+    // Otherwise the spike sits in the gap before a frame; just let the
+    // next pulse absorb it.
+    return;
+  }
 
   if (duration > RCSwitch::nSeparationLimit) {
     // A long stretch without signal level change occurred. This could
     // be the gap between two transmission.
-    if ((repeatCount==0) || (diff(duration, RCSwitch::timings[0]) < 200)) {
+    bool complete = false;
+    if (this->bLowLatency) {
+      // Senders transmit the sync after the data, so this gap is the sync
+      // of the frame just recorded: decode that frame right away.
+      if (changeCount > 7) {
+        timings[0] = duration;
+        complete = true;
+      }
+    } else if ((repeatCount==0) || (diff(duration, timings[0]) < 200)) {
       // This long signal is close in length to the long signal which
       // started the previously recorded timings; this suggests that
       // it may indeed by a a gap between two transmissions (we assume
@@ -688,15 +1474,23 @@ void RECEIVE_ATTR RCSwitch::handleInterrupt() {
       // with roughly the same gap between them).
       repeatCount++;
       if (repeatCount == 2) {
-        for(unsigned int i = 1; i <= numProto; i++) {
-          if (receiveProtocol(i, changeCount)) {
-            // receive succeeded for protocol i
-            break;
-          }
-        }
+        complete = true;
         repeatCount = 0;
       }
     }
+    if (complete) {
+      if (!this->bDeferredDecoding) {
+        decodeFrame(timings, changeCount, time);
+      } else if (this->nPendingChanges == 0) {
+        // hand the frame over to decodePending() and record into the other buffer
+        this->nPendingTime = time;
+        this->nPendingChanges = changeCount;
+        this->nCaptureBuffer ^= 1;
+        timings = this->timings[this->nCaptureBuffer];
+      } else {
+        this->nCaptureOverrun = this->nCaptureOverrun + 1;
+      }
+    }
     changeCount = 0;
   }
  
@@ -706,7 +1500,7 @@ void RECEIVE_ATTR RCSwitch::handleInterrupt() {
     repeatCount = 0;
   }
 
-  RCSwitch::timings[changeCount++] = duration;
+  timings[changeCount++] = duration;
   lastTime = time;  
 }
 #endif
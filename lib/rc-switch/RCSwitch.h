@@ -43,6 +43,8 @@
     #include <wiringPi.h>
 #elif defined(SPARK)
     #include "application.h"
+#elif defined(RCSWITCH_HOST) // desktop build, see RCSwitchHost.h
+    #include "RCSwitchHost.h"
 #else
     #include "WProgram.h"
 #endif
@@ -56,14 +58,94 @@
 #define RCSwitchDisableReceiving
 #endif
 
+// Longest code, in bits, that can be sent or received. Up to 32 bits codes
+// are held in an unsigned long; anything wider switches RCSwitch::Code to a
+// uint64_t and grows the receive buffers accordingly, so builds that stick
+// to the default keep the original memory footprint.
+#ifndef RCSWITCH_MAX_BITS
+#define RCSWITCH_MAX_BITS 32
+#endif
+
+#if RCSWITCH_MAX_BITS > 64
+#error "RCSWITCH_MAX_BITS can be at most 64"
+#endif
+
 // Number of maximum high/Low changes per packet.
-// We can handle up to (unsigned long) => 32 bit * 2 H/L changes per bit + 2 for sync
-#define RCSWITCH_MAX_CHANGES 67
+// We can handle up to RCSWITCH_MAX_BITS * 2 H/L changes per bit + 3 for sync
+#define RCSWITCH_MAX_CHANGES (RCSWITCH_MAX_BITS * 2 + 3)
+
+// Upper bound on the number of entries in the built-in protocol table.
+#define RCSWITCH_MAX_PROTOCOLS 16
+
+// Number of decoded frames buffered between the receive interrupt and the
+// main loop. Must be a power of two and not larger than 128.
+#ifndef RCSWITCH_RX_QUEUE_SIZE
+#define RCSWITCH_RX_QUEUE_SIZE 8
+#endif
+
+// Number of RCSwitch instances that can receive at the same time, each on
+// its own interrupt.
+#ifndef RCSWITCH_MAX_RECEIVERS
+#define RCSWITCH_MAX_RECEIVERS 2
+#endif
+
+// Received frames are only matched against the protocols whose ratio of sync
+// length to bit length is closest to the measured one: at most this many per
+// sync position (leading high or leading low).
+#ifndef RCSWITCH_MAX_CANDIDATES
+#define RCSWITCH_MAX_CANDIDATES 2
+#endif
+
+// How far, in percent, the measured sync/bit ratio may be off from a
+// protocol's nominal ratio for that protocol to be considered at all.
+#ifndef RCSWITCH_SYNC_RATIO_TOLERANCE
+#define RCSWITCH_SYNC_RATIO_TOLERANCE 25
+#endif
+
+// Sender calibration (see setSenderCalibration()): number of senders
+// remembered, frames needed before a sender's own window is used, and that
+// window as a multiple of the sender's jitter plus a minimum in microseconds.
+#ifndef RCSWITCH_MAX_SENDERS
+#define RCSWITCH_MAX_SENDERS 8
+#endif
+#define RCSWITCH_SENDER_MIN_SAMPLES 3
+#define RCSWITCH_SENDER_JITTER_FACTOR 2
+#define RCSWITCH_SENDER_MIN_TOLERANCE 40
+
+// ReceivedFrame::flags
+// the code was seen in at least two frames of the transmission
+#define RCSWITCH_FRAME_CONFIRMED 0x01
+// follow-up on a frame delivered earlier in the same transmission (low
+// latency mode only), carrying that frame's value
+#define RCSWITCH_FRAME_REPEAT 0x02
+// the repeats contradicted the frame delivered earlier
+#define RCSWITCH_FRAME_CANCELLED 0x04
+
+// In low latency mode, a transmission is considered over once no frame has
+// been decoded for this many microseconds.
+#ifndef RCSWITCH_REPEAT_TIMEOUT
+#define RCSWITCH_REPEAT_TIMEOUT 250000
+#endif
+// In low latency mode, agreeing repeats of a held button are delivered at
+// most this often (microseconds)
+#ifndef RCSWITCH_HOLD_INTERVAL
+#define RCSWITCH_HOLD_INTERVAL 100000
+#endif
 
 class RCSwitch {
 
   public:
+    /** Holds a code of up to RCSWITCH_MAX_BITS bits */
+#if RCSWITCH_MAX_BITS > 32
+    typedef uint64_t Code;
+#else
+    typedef unsigned long Code;
+#endif
+
     RCSwitch();
+    #if not defined( RCSwitchDisableReceiving )
+    ~RCSwitch();
+    #endif
     
     void switchOn(int nGroupNumber, int nSwitchNumber);
     void switchOff(int nGroupNumber, int nSwitchNumber);
@@ -76,9 +158,79 @@ class RCSwitch {
     void switchOn(char sGroup, int nDevice);
     void switchOff(char sGroup, int nDevice);
 
+    /**
+     * The low 'length' bits of 'code', as passed to send(). A tri-state
+     * code word takes two bits per symbol: 0 = 00, F = 01, 1 = 11. A length
+     * of 0 marks invalid switch parameters.
+     */
+    struct CodeWord {
+        Code code;
+        unsigned int length;
+    };
+
+    /**
+     * Code words of the switchOn()/switchOff() families, computed directly as
+     * bits. All are constexpr, so codes known at compile time cost nothing
+     * at run time, e.g.
+     *   static constexpr RCSwitch::CodeWord kLampOn = RCSwitch::codeWordB(2, 3, true);
+     */
+    /**
+     * Type A, 10 pole DIP switches: 5 symbols group, 5 symbols device (on
+     * switch = 0, off switch = F), then on = 0F, off = F0.
+     */
+    static constexpr CodeWord codeWordA(const char* sGroup, const char* sDevice, bool bStatus) {
+        return CodeWord{ (dipSymbols(sGroup, 5) << 14) | (dipSymbols(sDevice, 5) << 4) | (bStatus ? 0x1 : 0x4), 24 };
+    }
+    /**
+     * Type B, two rotary/sliding switches:
+     *
+     * +-----------------------------+-----------------------------+----------+------------+
+     * | 4 bits address              | 4 bits address              | 3 bits   | 1 bit      |
+     * | switch group                | switch number               | not used | on / off   |
+     * | 1=0FFF 2=F0FF 3=FF0F 4=FFF0 | 1=0FFF 2=F0FF 3=FF0F 4=FFF0 | FFF      | on=F off=0 |
+     * +-----------------------------+-----------------------------+----------+------------+
+     */
+    static constexpr CodeWord codeWordB(int nAddressCode, int nChannelCode, bool bStatus) {
+        return (nAddressCode < 1 || nAddressCode > 4 || nChannelCode < 1 || nChannelCode > 4) ? CodeWord{ 0, 0 } :
+            CodeWord{ (selectSymbol(fSymbols(4), 4, nAddressCode - 1, 0) << 16) |
+                      (selectSymbol(fSymbols(4), 4, nChannelCode - 1, 0) << 8) |
+                      (fSymbols(3) << 2) | (bStatus ? 0x1 : 0x0), 24 };
+    }
+    /**
+     * Type C, Intertechno: family a..p as 4 bits, device - 1 and group - 1 as
+     * 2 bits each, lowest bit first (1 = F), then 0FF and on = F, off = 0.
+     */
+    static constexpr CodeWord codeWordC(char sFamily, int nGroup, int nDevice, bool bStatus) {
+        return (sFamily < 'a' || sFamily > 'p' || nGroup < 1 || nGroup > 4 || nDevice < 1 || nDevice > 4) ? CodeWord{ 0, 0 } :
+            CodeWord{ (bitSymbols(sFamily - 'a', 4) << 16) |
+                      (bitSymbols((nDevice - 1) | ((nGroup - 1) << 2), 4) << 8) |
+                      0x14 | (bStatus ? 0x1 : 0x0), 24 };
+    }
+    /**
+     * Type D, REV:
+     *
+     * +-----------------------------+-------------------+----------+--------------+
+     * | 4 bits address              | 3 bits address    | 3 bits   | 2 bits       |
+     * | switch group                | device number     | not used | on / off     |
+     * | A=1FFF B=F1FF C=FF1F D=FFF1 | 1=1FF 2=F1F 3=FF1 | 000      | on=10 off=01 |
+     * +-----------------------------+-------------------+----------+--------------+
+     *
+     * Source: http://www.the-intruder.net/funksteckdosen-von-rev-uber-arduino-ansteuern/
+     */
+    static constexpr CodeWord codeWordD(char sGroup, int nDevice, bool bStatus) {
+        return (groupIndexD(sGroup) < 0 || groupIndexD(sGroup) > 3 || nDevice < 1 || nDevice > 3) ? CodeWord{ 0, 0 } :
+            CodeWord{ (selectSymbol(fSymbols(4), 4, groupIndexD(sGroup), 3) << 16) |
+                      (selectSymbol(fSymbols(3), 3, nDevice - 1, 3) << 10) |
+                      (bStatus ? 0xC : 0x3), 24 };
+    }
+
     void sendTriState(const char* sCodeWord);
-    void send(unsigned long code, unsigned int length);
+    void send(Code code, unsigned int length);
+    void send(CodeWord word);
     void send(const char* sCodeWord);
+    bool sendAsync(Code code, unsigned int length);
+    bool isTransmitting();
+    void onTransmitComplete(void (*callback)(void));
     
     #if not defined( RCSwitchDisableReceiving )
     void enableReceive(int interrupt);
@@ -87,7 +239,7 @@ class RCSwitch {
     bool available();
     void resetAvailable();
 
-    unsigned long getReceivedValue();
+    Code getReceivedValue();
     unsigned int getReceivedBitlength();
     unsigned int getReceivedDelay();
     unsigned int getReceivedProtocol();
@@ -147,35 +299,251 @@ class RCSwitch {
     void setProtocol(Protocol protocol);
     void setProtocol(int nProtocol);
     void setProtocol(int nProtocol, int nPulseLength);
+    static int getProtocolCount();
+
+    #if not defined( RCSwitchDisableReceiving )
+    /**
+     * Inclusive range of durations in microseconds accepted for one pulse.
+     */
+    struct PulseWindow {
+        uint32_t min;
+        uint32_t max;
+    };
+
+    /**
+     * A single decoded transmission. Frames are queued by the receive
+     * interrupt and consumed by readFrame()/drainFrames(), so codes arriving
+     * while the main loop is busy are buffered instead of overwritten.
+     */
+    struct ReceivedFrame {
+        Code value;
+        unsigned int bitlength;
+        unsigned int delay;
+        unsigned int protocol;
+        /** micros() when the frame was decoded */
+        unsigned long timestamp;
+        /** RCSWITCH_FRAME_* */
+        uint8_t flags;
+    };
+
+    bool readFrame(ReceivedFrame &frame);
+    unsigned int drainFrames(ReceivedFrame* frames, unsigned int nMaxFrames);
+    unsigned int getPendingFrames();
+    unsigned int getOverflowCount();
+    void resetOverflowCount();
+
+    void setDeferredDecoding(bool bDeferred);
+    bool decodePending();
+    unsigned int getCaptureOverrunCount();
+
+    void setGlitchFilter(unsigned int nMinPulseMicros);
+    void setEdgeRateLimit(unsigned int nMaxEdges, unsigned long nWindowMicros, unsigned long nMaskMicros);
+    unsigned int getGlitchCount();
+    unsigned int getRateLimitCount();
+
+    void setSenderCalibration(bool bEnable);
+    unsigned int getCalibratedCount();
+
+    void setLowLatency(bool bEnable);
+    unsigned long getLastFrameTime();
+    #endif
 
   private:
-    char* getCodeWordA(const char* sGroup, const char* sDevice, bool bStatus);
-    char* getCodeWordB(int nGroupNumber, int nSwitchNumber, bool bStatus);
-    char* getCodeWordC(char sFamily, int nGroup, int nDevice, bool bStatus);
-    char* getCodeWordD(char group, int nDevice, bool bStatus);
+    /* count F symbols */
+    static constexpr Code fSymbols(unsigned int count) {
+        return (count == 0) ? 0 : (fSymbols(count - 1) << 2) | 1;
+    }
+    /* symbols, first one most significant, with symbol 'index' set to 'value' */
+    static constexpr Code selectSymbol(Code symbols, unsigned int count, int index, unsigned int value) {
+        return (symbols & ~((Code)3 << (2 * (count - 1 - index)))) | ((Code)value << (2 * (count - 1 - index)));
+    }
+    /* one symbol per bit of 'bits', lowest bit first: 1 = F, 0 = 0 */
+    static constexpr Code bitSymbols(unsigned int bits, unsigned int count) {
+        return (count == 0) ? 0 : ((Code)(bits & 1) << (2 * (count - 1))) | bitSymbols(bits >> 1, count - 1);
+    }
+    /* one symbol per DIP switch: on ('1') = 0, off ('0') = F */
+    static constexpr Code dipSymbols(const char* sSwitches, unsigned int count) {
+        return (count == 0) ? 0 : (dipSymbols(sSwitches, count - 1) << 2) | (sSwitches[count - 1] == '0' ? 1 : 0);
+    }
+    static constexpr int groupIndexD(char sGroup) {
+        return (sGroup >= 'a') ? sGroup - 'a' : sGroup - 'A';
+    }
     void transmit(HighLow pulses);
+    static void transmitStep();
 
     #if not defined( RCSwitchDisableReceiving )
-    static void handleInterrupt();
-    static bool receiveProtocol(const int p, unsigned int changeCount);
+    typedef void (*InterruptHandler)(void);
+    void handleInterrupt();
+    template <int nSlot> static void handleInterruptSlot();
+    template <int nSlot> static InterruptHandler interruptHandlerFor(int slot);
+    /**
+     * Receive-side view of a protocol, prepared by buildMatchTables() so that
+     * receiveProtocol() gets by with multiplies and compares. The tables are
+     * built once, by the first constructor, and hold nothing that depends on
+     * the receive tolerance: that is applied per frame through
+     * nToleranceScale, so setReceiveTolerance() leaves them alone.
+     */
+    struct ProtocolMatch {
+        /** 65536 / sync length in pulses, rounded up */
+        uint32_t syncReciprocal;
+        HighLow zero;
+        HighLow one;
+        /** index of the first data duration after the sync */
+        uint8_t firstDataTiming;
+        /** length of the sync timing in pulses */
+        uint8_t syncLength;
+        /**
+         * Ratio of the sync duration to the first data bit (high + low), in
+         * 1/16ths: accepted range, midpoint, and nominal value for a zero
+         * and for a one bit.
+         */
+        uint16_t ratioMin;
+        uint16_t ratioMax;
+        uint16_t ratioCenter;
+        uint16_t ratioZero;
+        uint16_t ratioOne;
+    };
+
+    /**
+     * What the receiver has learned about one sender.
+     */
+    struct SenderProfile {
+        Code code;
+        /** protocol number, 0 for an unused profile */
+        uint8_t protocol;
+        /** frames learned from, saturating */
+        uint8_t samples;
+        /** pulse length and largest timing deviation, in 1/16 microseconds */
+        uint32_t pulse16;
+        uint32_t jitter16;
+        /** micros() when last heard */
+        unsigned long lastSeen;
+    };
+
+    static void buildMatchTables();
+    void maskReceiver();
+    void unmaskReceiver();
+    uint32_t toleranceOf(uint32_t delay) const;
+    static bool matchBits(const ProtocolMatch &m, const PulseWindow* w, const unsigned int* raw, unsigned int changeCount, Code &code);
+    bool receiveProtocol(const int p, const unsigned int* raw, unsigned int changeCount, Code &code, unsigned int &delay);
+    int receiveCalibrated(const unsigned int* raw, unsigned int changeCount, Code &code, unsigned int &delay);
+    void learnSender(int slot, int p, Code code, const unsigned int* raw, unsigned int changeCount, unsigned long timestamp);
+    bool decodeFrame(const unsigned int* raw, unsigned int changeCount, unsigned long timestamp);
+    void deliverFrame(Code value, unsigned int bitlength, unsigned int delay, unsigned int protocol, unsigned long timestamp);
+    void queueFrame(Code value, unsigned int bitlength, unsigned int delay, unsigned int protocol, unsigned long timestamp, uint8_t flags);
     int nReceiverInterrupt;
+    /* index into receivers[] while receiving, -1 otherwise */
+    int nReceiverSlot;
     #endif
     int nTransmitterPin;
     int nRepeatTransmit;
     
     Protocol protocol;
 
+    /*
+     * Asynchronous transmission, shared by all instances: txPulses holds the
+     * durations of one repeat in microseconds, alternating between the first
+     * and second logic level of the protocol, and is played back by
+     * transmitStep() from a timer interrupt.
+     */
+    static unsigned int txPulses[2 * RCSWITCH_MAX_BITS + 2];
+    volatile static unsigned int nTxIndex;
+    static unsigned int nTxCount;
+    volatile static unsigned int nTxRepeats;
+    static int nTxPin;
+    static bool bTxInverted;
+    volatile static bool bTransmitting;
+    volatile static bool bTransmitDone;
+    static void (*txCallback)(void);
+
     #if not defined( RCSwitchDisableReceiving )
-    static int nReceiveTolerance;
-    volatile static unsigned long nReceivedValue;
-    volatile static unsigned int nReceivedBitlength;
-    volatile static unsigned int nReceivedDelay;
-    volatile static unsigned int nReceivedProtocol;
+    /*
+     * Receive constants shared by all instances; they depend on the
+     * protocol table only and are built by the first constructor.
+     */
+    static ProtocolMatch protoMatch[];
+    static bool bMatchTablesBuilt;
+    /*
+     * Protocol numbers sorted by ratioCenter, split by firstDataTiming - 1,
+     * so decodeFrame() can find the plausible ones by binary search.
+     */
+    static uint8_t ratioIndex[2][RCSWITCH_MAX_PROTOCOLS];
+    static uint8_t nRatioIndexSize[2];
     const static unsigned int nSeparationLimit;
+    /*
+     * The instance each interrupt slot dispatches to. Every slot has its own
+     * handleInterruptSlot<n>() trampoline, so receivers on different pins
+     * share nothing below.
+     */
+    static RCSwitch* volatile receivers[RCSWITCH_MAX_RECEIVERS];
+
+    int nReceiveTolerance;
+    uint32_t nToleranceScale;
+    /*
+     * Single-producer/single-consumer ring of decoded frames. Only the
+     * interrupt handler advances nRxHead, only the main loop advances nRxTail;
+     * both are free running and masked on access.
+     */
+    ReceivedFrame rxQueue[RCSWITCH_RX_QUEUE_SIZE];
+    volatile uint8_t nRxHead;
+    volatile uint8_t nRxTail;
+    volatile unsigned int nRxOverflow;
     /* 
-     * timings[0] contains sync timing, followed by a number of bits
+     * timings[n][0] contains sync timing, followed by a number of bits.
+     *
+     * The interrupt handler records into timings[nCaptureBuffer]. With
+     * deferred decoding, a complete frame is handed to the main loop by
+     * flipping nCaptureBuffer; the other buffer then holds nPendingChanges
+     * timings until decodePending() has run.
      */
-    static unsigned int timings[RCSWITCH_MAX_CHANGES];
+    unsigned int timings[2][RCSWITCH_MAX_CHANGES];
+    volatile uint8_t nCaptureBuffer;
+    volatile unsigned int nPendingChanges;
+    volatile unsigned long nPendingTime;
+    volatile unsigned int nCaptureOverrun;
+    bool bDeferredDecoding;
+    /* capture state of the interrupt handler */
+    unsigned int nChangeCount;
+    unsigned long nLastTime;
+    unsigned int nRepeatCount;
+
+    /*
+     * Noise suppression in the interrupt handler: pulses shorter than
+     * nMinPulse are merged into the surrounding pulse, and more than
+     * nMaxEdges edges within nEdgeWindow microseconds mask the receive
+     * interrupt for nMaskDuration microseconds.
+     */
+    unsigned int nMinPulse;
+    unsigned int nMaxEdges;
+    unsigned long nEdgeWindow;
+    unsigned long nMaskDuration;
+    unsigned long nWindowStart;
+    unsigned int nWindowEdges;
+    volatile bool bReceiverMasked;
+    volatile unsigned long nMaskedSince;
+    volatile unsigned int nGlitchCount;
+    volatile unsigned int nRateLimitCount;
+
+    /*
+     * Low latency mode: every frame is decoded as soon as it is complete.
+     * llCode/llBitlength/llDelay/llProtocol is the frame delivered first in
+     * the current transmission, llState whether it is unconfirmed (1) or
+     * confirmed (2), llDelivered when the last frame of it was queued.
+     */
+    bool bLowLatency;
+    Code llCode;
+    uint8_t llBitlength;
+    unsigned int llDelay;
+    uint8_t llProtocol;
+    uint8_t llState;
+    unsigned long llLastTime;
+    unsigned long llDelivered;
+    /* micros() of the last decoded frame, queued or not */
+    volatile unsigned long nLastFrameTime;
+
+    bool bSenderCalibration;
+    SenderProfile senders[RCSWITCH_MAX_SENDERS];
+    volatile unsigned int nCalibratedCount;
     #endif
 
     
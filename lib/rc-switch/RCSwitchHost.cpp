@@ -0,0 +1,82 @@
+/*
+  RCSwitchHost - minimal hardware abstraction to build RCSwitch on a desktop
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+*/
+#if defined(RCSWITCH_HOST)
+
+#include "RCSwitchHost.h"
+
+static unsigned long nowMicros = 0;
+static void (*handlers[RCSWITCH_HOST_MAX_INTERRUPTS])(void);
+static void (*writeHook)(int pin, int level, unsigned long time) = 0;
+static void (*timerHandler)(void) = 0;
+static unsigned long timerDue = 0;
+
+/**
+ * Moves the clock to now + us, firing the timer at its deadline on the way.
+ */
+static void advanceTo(unsigned long us) {
+  const unsigned long target = nowMicros + us;
+  while (timerHandler && (long)(target - timerDue) >= 0) {
+    void (*handler)(void) = timerHandler;
+    timerHandler = 0;
+    nowMicros = timerDue;
+    handler();
+  }
+  nowMicros = target;
+}
+
+unsigned long micros() {
+  return nowMicros;
+}
+
+void delayMicroseconds(unsigned int us) {
+  advanceTo(us);
+}
+
+void pinMode(int, int) {
+}
+
+void digitalWrite(int pin, int level) {
+  if (writeHook) {
+    writeHook(pin, level, nowMicros);
+  }
+}
+
+void attachInterrupt(int interrupt, void (*handler)(void), int) {
+  if (interrupt >= 0 && interrupt < RCSWITCH_HOST_MAX_INTERRUPTS) {
+    handlers[interrupt] = handler;
+  }
+}
+
+void detachInterrupt(int interrupt) {
+  if (interrupt >= 0 && interrupt < RCSWITCH_HOST_MAX_INTERRUPTS) {
+    handlers[interrupt] = 0;
+  }
+}
+
+void rcswitchHostAdvance(unsigned long us) {
+  advanceTo(us);
+}
+
+void rcswitchHostEdge(int interrupt, unsigned int duration) {
+  advanceTo(duration);
+  if (interrupt >= 0 && interrupt < RCSWITCH_HOST_MAX_INTERRUPTS && handlers[interrupt]) {
+    handlers[interrupt]();
+  }
+}
+
+void rcswitchHostOnWrite(void (*hook)(int pin, int level, unsigned long time)) {
+  writeHook = hook;
+}
+
+void rcswitchHostTimer(unsigned long us, void (*handler)(void)) {
+  timerDue = nowMicros + us;
+  timerHandler = handler;
+}
+
+#endif
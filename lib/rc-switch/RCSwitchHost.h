@@ -0,0 +1,70 @@
+/*
+  RCSwitchHost - minimal hardware abstraction to build RCSwitch on a desktop
+
+  Selected by defining RCSWITCH_HOST. Time is simulated: micros() only moves
+  when the host advances it, either explicitly or through
+  delayMicroseconds(), so recorded traces can be replayed through the
+  receive interrupt handler much faster than real time, and transmissions
+  can be captured edge by edge. A single one-shot timer stands in for the
+  hardware timer used by asynchronous transmissions; it fires whenever the
+  clock is moved past its deadline.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+*/
+#ifndef _RCSwitchHost_h
+#define _RCSwitchHost_h
+
+#include <stdint.h>
+#include <stdlib.h> /* abs */
+#include <string.h> /* memcpy */
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define CHANGE 1
+
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define memcpy_P(dest, src, num) memcpy((dest), (src), (num))
+
+// Highest interrupt number the shim keeps a handler for
+#define RCSWITCH_HOST_MAX_INTERRUPTS 32
+
+unsigned long micros();
+void delayMicroseconds(unsigned int us);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int level);
+void attachInterrupt(int interrupt, void (*handler)(void), int mode);
+void detachInterrupt(int interrupt);
+
+/**
+ * Moves the simulated clock forward by us microseconds.
+ */
+void rcswitchHostAdvance(unsigned long us);
+
+/**
+ * Moves the simulated clock forward by duration microseconds, then signals
+ * a level change on the given interrupt, as a receiver would at the end of
+ * a pulse.
+ */
+void rcswitchHostEdge(int interrupt, unsigned int duration);
+
+/**
+ * Installs a function called for every digitalWrite(), with the simulated
+ * time of the write. Pass 0 to remove it.
+ */
+void rcswitchHostOnWrite(void (*hook)(int pin, int level, unsigned long time));
+
+/**
+ * Arms the one-shot timer to call handler us microseconds from now. The
+ * handler may re-arm the timer. Pass a null handler to disarm it.
+ */
+void rcswitchHostTimer(unsigned long us, void (*handler)(void));
+
+#endif
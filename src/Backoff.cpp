@@ -0,0 +1,20 @@
+#include "Backoff.h"
+
+Backoff::Backoff(unsigned long baseMs, unsigned long maxMs)
+    : base(baseMs), max(maxMs), failed(0) {
+}
+
+unsigned long Backoff::next(uint32_t entropy) {
+    unsigned long step = base;
+    for (uint8_t i = 0; i < failed && step < max; i++) {
+        step <<= 1;
+    }
+    if (step > max) {
+        step = max;
+    }
+    if (failed < 255) {
+        failed++;
+    }
+    const unsigned long half = step / 2;
+    return (step - half) + entropy % (half + 1);
+}
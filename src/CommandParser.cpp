@@ -0,0 +1,107 @@
+#include "CommandParser.h"
+#include <string.h>
+
+namespace {
+
+// Unparsed rest of the payload
+struct Cursor {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    bool atEnd() const { return p == end; }
+    bool take(char c) {
+        if (p == end || *p != c) return false;
+        p++;
+        return true;
+    }
+};
+
+bool parseUnsigned(Cursor& in, unsigned long& value) {
+    const uint8_t* start = in.p;
+    value = 0;
+    while (in.p < in.end && *in.p >= '0' && *in.p <= '9') {
+        const unsigned long next = value * 10 + (*in.p - '0');
+        if (next / 10 != value) return false;  // overflow
+        value = next;
+        in.p++;
+    }
+    return in.p != start;
+}
+
+bool parseSwitch(Cursor& in, Command& command) {
+    command.mask = 0;
+    while (in.p < in.end && *in.p >= '1' && *in.p <= '0' + COMMAND_MAX_SWITCHES) {
+        command.mask |= 1 << (*in.p - '1');
+        in.p++;
+    }
+    if (command.mask == 0 || !in.take(':')) return false;
+    if (in.take('0')) {
+        command.value = 0;
+    } else if (in.take('1')) {
+        command.value = 1;
+    } else {
+        return false;
+    }
+    return in.atEnd();
+}
+
+bool parsePing(Cursor& in, Command&) {
+    return in.atEnd();
+}
+
+bool parseRate(Cursor& in, Command& command) {
+    for (int i = 0; i < 3; i++) {
+        if (!in.take(':') || !parseUnsigned(in, command.args[i])) return false;
+    }
+    return in.atEnd();
+}
+
+struct CommandSpec {
+    const char* keyword;
+    Command::Type type;
+    bool (*parse)(Cursor& in, Command& command);
+};
+
+// Sorted by keyword, for the binary search in parseCommand()
+const CommandSpec commandSpecs[] = {
+    { "ping", Command::PING,   parsePing },
+    { "rate", Command::RATE,   parseRate },
+    { "sw",   Command::SWITCH, parseSwitch },
+};
+
+}  // namespace
+
+bool parseCommand(const uint8_t* payload, unsigned int length, Command& command) {
+    Cursor in = { payload, payload + length };
+    while (in.end > in.p && (in.end[-1] == ' ' || in.end[-1] == '\r' || in.end[-1] == '\n' || in.end[-1] == '\t')) {
+        in.end--;
+    }
+
+    // keyword: the leading run of lower case letters
+    const uint8_t* keyword = in.p;
+    while (in.p < in.end && *in.p >= 'a' && *in.p <= 'z') {
+        in.p++;
+    }
+    const size_t keywordLength = in.p - keyword;
+
+    int lo = 0;
+    int hi = sizeof(commandSpecs) / sizeof(commandSpecs[0]) - 1;
+    while (lo <= hi) {
+        const int mid = (lo + hi) / 2;
+        const CommandSpec& spec = commandSpecs[mid];
+        int order = strncmp((const char*)keyword, spec.keyword, keywordLength);
+        if (order == 0 && spec.keyword[keywordLength] != '\0') {
+            order = -1;  // keyword is a proper prefix of spec.keyword
+        }
+        if (order == 0) {
+            command.type = spec.type;
+            return spec.parse(in, command);
+        }
+        if (order < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return false;
+}
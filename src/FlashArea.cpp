@@ -0,0 +1,120 @@
+#include "FlashArea.h"
+#include <string.h>
+
+#if defined(RCSWITCH_HOST)
+
+static uint8_t hostFlash[FLASH_AREA_HOST_SECTORS * FLASH_AREA_SECTOR_SIZE];
+static unsigned long hostErases[FLASH_AREA_HOST_SECTORS];
+static bool hostReady = false;
+
+static uint8_t* hostArea() {
+    if (!hostReady) {
+        flashAreaHostErase();
+    }
+    return hostFlash;
+}
+
+void flashAreaHostErase() {
+    memset(hostFlash, 0xFF, sizeof(hostFlash));
+    memset(hostErases, 0, sizeof(hostErases));
+    hostReady = true;
+}
+
+uint8_t* flashAreaHostData() {
+    return hostArea();
+}
+
+unsigned long flashAreaHostEraseCount(uint16_t sector) {
+    return sector < FLASH_AREA_HOST_SECTORS ? hostErases[sector] : 0;
+}
+
+FlashArea flashArea(uint16_t first, uint16_t count) {
+    FlashArea area = { 0, 0 };
+    if ((uint32_t)first + count <= FLASH_AREA_HOST_SECTORS) {
+        area.base = first * FLASH_AREA_SECTOR_SIZE;
+        area.sectors = count;
+    }
+    return area;
+}
+
+#else
+
+#include <Arduino.h>
+
+// Bounds of the filesystem area, from the linker script
+extern "C" uint32_t _FS_start;
+extern "C" uint32_t _FS_end;
+
+#define FLASH_AREA_MAPPED 0x40200000UL   // where the flash is mapped
+
+FlashArea flashArea(uint16_t first, uint16_t count) {
+    const uint32_t start = (uint32_t)&_FS_start - FLASH_AREA_MAPPED;
+    const uint32_t end = (uint32_t)&_FS_end - FLASH_AREA_MAPPED;
+    FlashArea area = { 0, 0 };
+    if (end > start && (end - start) / FLASH_AREA_SECTOR_SIZE >= (uint32_t)first + count) {
+        area.base = start + first * FLASH_AREA_SECTOR_SIZE;
+        area.sectors = count;
+    }
+    return area;
+}
+
+#endif
+
+static bool inArea(const FlashArea& area, uint32_t offset, uint32_t size) {
+    const uint32_t end = (uint32_t)area.sectors * FLASH_AREA_SECTOR_SIZE;
+    return offset <= end && size <= end - offset && (offset | size) % 4 == 0;
+}
+
+bool FlashArea::read(uint32_t offset, uint32_t* data, uint32_t size) const {
+    if (!inArea(*this, offset, size)) {
+        return false;
+    }
+#if defined(RCSWITCH_HOST)
+    memcpy(data, hostArea() + base + offset, size);
+    return true;
+#else
+    return ESP.flashRead(base + offset, data, size);
+#endif
+}
+
+bool FlashArea::write(uint32_t offset, const uint32_t* data, uint32_t size) const {
+    if (!inArea(*this, offset, size)) {
+        return false;
+    }
+#if defined(RCSWITCH_HOST)
+    // programming can only clear bits
+    uint8_t* flash = hostArea() + base + offset;
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (uint32_t i = 0; i < size; i++) {
+        flash[i] &= bytes[i];
+    }
+    return true;
+#else
+    return ESP.flashWrite(base + offset, const_cast<uint32_t*>(data), size);
+#endif
+}
+
+bool FlashArea::erase(uint16_t sector) const {
+    if (sector >= sectors) {
+        return false;
+    }
+#if defined(RCSWITCH_HOST)
+    const uint32_t first = base / FLASH_AREA_SECTOR_SIZE + sector;
+    memset(hostArea() + first * FLASH_AREA_SECTOR_SIZE, 0xFF, FLASH_AREA_SECTOR_SIZE);
+    hostErases[first]++;
+    return true;
+#else
+    return ESP.flashEraseSector(base / FLASH_AREA_SECTOR_SIZE + sector);
+#endif
+}
+
+uint8_t flashCrc8(const uint8_t* data, unsigned int length) {
+    uint8_t crc = 0;
+    while (length--) {
+        crc ^= *data++;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,347 @@
+#include "RfEventStore.h"
+#include <string.h>
+
+#define RF_EVENT_MAGIC 0x5A
+#define RF_SEQ_MAGIC 0xA3       // a mark, see reserve()
+#define RECORDS_PER_SECTOR (FLASH_AREA_SECTOR_SIZE / sizeof(Record))
+
+RfEventStore::RfEventStore()
+    : ramHead(0), ramCount(0), area(), readSector(0), readSlot(0),
+      writeSector(0), writeSlot(0), writeReady(false), flashCount(0),
+      nextSeq(1), bootSeq(1), reserved(1), spilled(0), dropped(0) {
+}
+
+// Event or mark stored in a slot; false for erased, torn or foreign records
+bool RfEventStore::readRecord(uint16_t sector, uint16_t slot, Record& record) const {
+    return area.read(sector * FLASH_AREA_SECTOR_SIZE + slot * sizeof(Record),
+                     (uint32_t*)&record, sizeof(Record)) &&
+           (record.magic == RF_EVENT_MAGIC || record.magic == RF_SEQ_MAGIC) &&
+           record.crc == flashCrc8((const uint8_t*)&record, sizeof(Record) - 1);
+}
+
+// Event stored in a slot; false for anything else
+bool RfEventStore::readEvent(uint16_t sector, uint16_t slot, RfEvent& event) const {
+    Record record;
+    if (!readRecord(sector, slot, record) || record.magic != RF_EVENT_MAGIC) {
+        return false;
+    }
+    event.seq = record.seq;
+    event.time = record.time;
+    event.code = record.code;
+    event.bits = record.bits;
+    event.protocol = record.protocol;
+    return true;
+}
+
+// First slot of the sector that was never written; written slots are a prefix
+uint16_t RfEventStore::findFree(uint16_t sector) const {
+    uint16_t lo = 0;
+    uint16_t hi = RECORDS_PER_SECTOR;
+    while (lo < hi) {
+        const uint16_t mid = (lo + hi) / 2;
+        uint32_t words[sizeof(Record) / 4];
+        bool erased = area.read(sector * FLASH_AREA_SECTOR_SIZE + mid * sizeof(Record),
+                                words, sizeof(words));
+        for (uint8_t i = 0; erased && i < sizeof(Record) / 4; i++) {
+            erased = words[i] == 0xFFFFFFFF;
+        }
+        if (erased) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+bool RfEventStore::begin(const FlashArea& flash) {
+    if (flash.sectors == 0) {
+        return false;
+    }
+    area = flash;
+
+    // Sectors are filled one after another, so the sector that starts with
+    // the lowest sequence number holds the oldest records and the one with
+    // the highest the newest
+    bool found = false;
+    uint32_t oldest = 0;
+    uint32_t newest = 0;
+    for (uint16_t s = 0; s < area.sectors; s++) {
+        Record first;
+        if (!readRecord(s, 0, first)) {
+            continue;
+        }
+        if (!found || (int32_t)(first.seq - oldest) < 0) {
+            oldest = first.seq;
+            readSector = s;
+        }
+        if (!found || (int32_t)(first.seq - newest) > 0) {
+            newest = first.seq;
+            writeSector = s;
+        }
+        found = true;
+    }
+    if (!found) {
+        readSector = writeSector = 0;
+        readSlot = writeSlot = 0;
+        writeReady = false;
+        return true;
+    }
+
+    readSlot = 0;
+    writeSlot = findFree(writeSector);
+    writeReady = true;
+    for (uint16_t s = readSector;; s = (s + 1) % area.sectors) {
+        const uint16_t end = (s == writeSector) ? writeSlot : RECORDS_PER_SECTOR;
+        for (uint16_t slot = 0; slot < end; slot++) {
+            Record record;
+            if (!readRecord(s, slot, record)) {
+                continue;
+            }
+            // numbers up to a mark's reservation may have gone out already
+            const uint32_t used = (record.magic == RF_EVENT_MAGIC) ? record.seq + 1 : record.time;
+            if ((int32_t)(used - nextSeq) > 0) {
+                nextSeq = used;
+            }
+            if (record.magic == RF_EVENT_MAGIC) {
+                flashCount++;
+            }
+        }
+        if (s == writeSector) {
+            break;
+        }
+    }
+    bootSeq = nextSeq;
+    reserved = nextSeq;
+    return true;
+}
+
+// Events delivered straight from RAM leave no trace in flash, and a fully
+// delivered ring is erased, so the sequence numbers handed out are covered
+// by marks: a record that reserves the next RF_EVENT_SEQ_BLOCK numbers. On
+// a restart, numbering resumes after the highest reservation found.
+void RfEventStore::reserve() {
+    const uint32_t limit = nextSeq + RF_EVENT_SEQ_BLOCK;
+    if (writeMark(limit)) {
+        reserved = limit;
+    }
+}
+
+bool RfEventStore::writeMark(uint32_t limit) {
+    Record record;
+    record.seq = nextSeq;
+    record.time = limit;
+    record.code = 0;
+    record.bits = 0;
+    record.protocol = 0;
+    record.magic = RF_SEQ_MAGIC;
+    return append(record);
+}
+
+void RfEventStore::push(uint32_t code, uint8_t bits, uint8_t protocol, unsigned long now) {
+    if (ramCount == RF_EVENT_RAM_SIZE) {
+        if (!spill(ram[ramHead])) {
+            dropped++;
+        }
+        ramHead = (ramHead + 1) % RF_EVENT_RAM_SIZE;
+        ramCount--;
+    }
+    if (area.sectors > 0 && (int32_t)(nextSeq - reserved) >= 0) {
+        reserve();
+    }
+    RfEvent& event = ram[(ramHead + ramCount) % RF_EVENT_RAM_SIZE];
+    event.seq = nextSeq++;
+    event.time = now;
+    event.code = code;
+    event.bits = bits;
+    event.protocol = protocol;
+    ramCount++;
+}
+
+void RfEventStore::persist() {
+    while (ramCount > 0) {
+        if (!spill(ram[ramHead])) {
+            dropped++;
+        }
+        ramHead = (ramHead + 1) % RF_EVENT_RAM_SIZE;
+        ramCount--;
+    }
+}
+
+// End of the written part of the read sector
+uint16_t RfEventStore::readEnd() const {
+    return (readSector == writeSector) ? writeSlot : RECORDS_PER_SECTOR;
+}
+
+// Moves the read position onto the oldest event in flash, past torn or
+// foreign records; false if there is none
+bool RfEventStore::seekFlash(RfEvent& event) {
+    while (flashCount > 0) {
+        for (; readSlot < readEnd(); readSlot++) {
+            if (readEvent(readSector, readSlot, event)) {
+                return true;
+            }
+        }
+        if (readSector == writeSector) {
+            flashCount = 0;  // miscounted; nothing left to read
+            break;
+        }
+        nextReadSector();
+    }
+    return false;
+}
+
+bool RfEventStore::peek(RfEvent& event) {
+    if (seekFlash(event)) {
+        return true;
+    }
+    if (ramCount == 0) {
+        return false;
+    }
+    event = ram[ramHead];
+    return true;
+}
+
+unsigned int RfEventStore::peek(RfEvent* events, unsigned int max) {
+    if (max == 0 || !peek(events[0])) {
+        return 0;
+    }
+    unsigned int n = 1;
+    unsigned int ram0 = 1;      // first RAM event not yet taken
+    if (flashCount > 0) {
+        // seekFlash() left readSlot on the first event; walk on from there
+        unsigned long left = flashCount - 1;
+        uint16_t sector = readSector;
+        uint16_t slot = readSlot + 1;
+        while (n < max && left > 0) {
+            const uint16_t end = (sector == writeSector) ? writeSlot : RECORDS_PER_SECTOR;
+            if (slot >= end) {
+                if (sector == writeSector) {
+                    return n;
+                }
+                sector = (sector + 1) % area.sectors;
+                slot = 0;
+                continue;
+            }
+            if (readEvent(sector, slot, events[n])) {
+                n++;
+                left--;
+            }
+            slot++;
+        }
+        if (left > 0) {
+            return n;
+        }
+        ram0 = 0;
+    }
+    for (unsigned int i = ram0; n < max && i < ramCount; i++) {
+        events[n++] = ram[(ramHead + i) % RF_EVENT_RAM_SIZE];
+    }
+    return n;
+}
+
+void RfEventStore::pop(unsigned int count) {
+    while (count--) {
+        pop();
+    }
+}
+
+void RfEventStore::pop() {
+    RfEvent event;
+    if (seekFlash(event)) {
+        readSlot++;
+        flashCount--;
+        if (flashCount == 0) {
+            // all delivered: start over on a clean sector
+            while (readSector != writeSector) {
+                nextReadSector();
+            }
+            area.erase(writeSector);
+            readSlot = writeSlot = 0;
+            writeReady = true;
+            writeMark(reserved);
+        } else if (readSlot >= RECORDS_PER_SECTOR && readSector != writeSector) {
+            nextReadSector();
+        }
+        return;
+    }
+    if (ramCount > 0) {
+        ramHead = (ramHead + 1) % RF_EVENT_RAM_SIZE;
+        ramCount--;
+    }
+}
+
+// Erases the fully read sector and moves on to the next
+void RfEventStore::nextReadSector() {
+    area.erase(readSector);
+    readSector = (readSector + 1) % area.sectors;
+    readSlot = 0;
+}
+
+void RfEventStore::dropSector() {
+    for (; readSlot < RECORDS_PER_SECTOR; readSlot++) {
+        RfEvent event;
+        if (readEvent(readSector, readSlot, event)) {
+            flashCount--;
+            dropped++;
+        }
+    }
+    readSector = (readSector + 1) % area.sectors;
+    readSlot = 0;
+}
+
+bool RfEventStore::spill(const RfEvent& event) {
+    Record record;
+    record.seq = event.seq;
+    record.time = event.time;
+    record.code = event.code;
+    record.bits = event.bits;
+    record.protocol = event.protocol;
+    record.magic = RF_EVENT_MAGIC;
+    if (!append(record)) {
+        return false;
+    }
+    flashCount++;
+    spilled++;
+    return true;
+}
+
+bool RfEventStore::append(Record& record) {
+    if (area.sectors == 0) {
+        return false;
+    }
+    record.crc = flashCrc8((const uint8_t*)&record, sizeof(Record) - 1);
+    // a record that does not read back correctly ends its sector; it gets
+    // one more try at the start of the next
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+        if (!writeReady || writeSlot >= RECORDS_PER_SECTOR) {
+            if (writeReady) {
+                const uint16_t next = (writeSector + 1) % area.sectors;
+                if (next == readSector && flashCount > 0) {
+                    dropSector();
+                }
+                writeSector = next;
+            }
+            if (!area.erase(writeSector)) {
+                writeReady = false;
+                return false;
+            }
+            writeSlot = 0;
+            writeReady = true;
+            if (flashCount == 0) {
+                readSector = writeSector;
+                readSlot = 0;
+            }
+        }
+        const uint32_t offset = writeSector * FLASH_AREA_SECTOR_SIZE + writeSlot * sizeof(Record);
+        writeSlot++;
+        Record check;
+        if (area.write(offset, (const uint32_t*)&record, sizeof(Record)) &&
+            area.read(offset, (uint32_t*)&check, sizeof(Record)) &&
+            memcmp(&record, &check, sizeof(Record)) == 0) {
+            return true;
+        }
+        writeSlot = RECORDS_PER_SECTOR;
+    }
+    return false;
+}
@@ -0,0 +1,72 @@
+#include "RfRatePolicy.h"
+
+RfRatePolicy::RfRatePolicy(RfRateRule perCode, RfRateRule global)
+    : perCode(perCode), global(global), globalTat(0), buckets(RF_RATE_IDLE_MS),
+      overrideCount(0), codeLimited(0), globalLimited(0) {
+}
+
+// The buckets are kept as GCRA state: tat is when the bucket will be full
+// again. An event conforms if at most burst - 1 intervals are still owed,
+// and taking a token pushes tat one interval further.
+bool RfRatePolicy::conforms(unsigned long tat, const RfRateRule& rule, unsigned long now) {
+    return (long)(tat - now) <= (long)(rule.burst - 1) * rule.intervalMs;
+}
+
+unsigned long RfRatePolicy::take(unsigned long tat, const RfRateRule& rule, unsigned long now) {
+    return ((long)(tat - now) > 0 ? tat : now) + rule.intervalMs;
+}
+
+RfRatePolicy::Verdict RfRatePolicy::check(unsigned long code, unsigned long now) {
+    const RfRateRule& rule = ruleFor(code);
+    // a forgotten bucket is a full one
+    unsigned long* tat = buckets.find(code, now);
+    if (tat && !conforms(*tat, rule, now)) {
+        codeLimited++;
+        return CODE_LIMITED;
+    }
+    // over the shared budget the event still counts against its code, so
+    // its repeats are not queued as well
+    const unsigned long next = take(tat ? *tat : now, rule, now);
+    buckets.store(code, now) = next;
+    if (!conforms(globalTat, global, now)) {
+        globalLimited++;
+        return GLOBAL_LIMITED;
+    }
+    globalTat = take(globalTat, global, now);
+    return ALLOW;
+}
+
+bool RfRatePolicy::setOverride(unsigned long code, RfRateRule rule) {
+    if ((unsigned long)rule.burst * rule.intervalMs > RF_RATE_IDLE_MS) {
+        return false;
+    }
+    for (uint8_t i = 0; i < overrideCount; i++) {
+        if (overrides[i].code == code) {
+            if (rule.burst == 0) {
+                overrides[i] = overrides[--overrideCount];
+            } else {
+                overrides[i].rule = rule;
+            }
+            return true;
+        }
+    }
+    if (rule.burst == 0) {
+        return true;
+    }
+    if (overrideCount >= RF_RATE_MAX_OVERRIDES) {
+        return false;
+    }
+    overrides[overrideCount].code = code;
+    overrides[overrideCount].rule = rule;
+    overrideCount++;
+    return true;
+}
+
+const RfRateRule& RfRatePolicy::ruleFor(unsigned long code) const {
+    for (uint8_t i = 0; i < overrideCount; i++) {
+        if (overrides[i].code == code) {
+            return overrides[i].rule;
+        }
+    }
+    return perCode;
+}
@@ -0,0 +1,69 @@
+#include "RfTxQueue.h"
+
+RfTxQueue::RfTxQueue() : count(0), nextSeq(0), dropped(0), coalesced(0) {
+}
+
+RfTxQueue::Result RfTxQueue::push(const RfTxRequest& request, RfTxRequest& evicted) {
+    for (uint8_t i = 0; i < count; i++) {
+        RfTxRequest& pending = entries[i].request;
+        if (pending.code == request.code && pending.bits == request.bits &&
+            pending.protocol == request.protocol) {
+            // keep its place in line, but send it as eagerly and as often
+            // as either request asked for
+            if (request.priority > pending.priority) pending.priority = request.priority;
+            if (request.repeats > pending.repeats) pending.repeats = request.repeats;
+            coalesced++;
+            return COALESCED;
+        }
+    }
+
+    if (count < RF_TX_QUEUE_SIZE) {
+        entries[count].request = request;
+        entries[count].seq = nextSeq++;
+        count++;
+        return QUEUED;
+    }
+
+    const int lowest = findLowest();
+    dropped++;
+    if (entries[lowest].request.priority >= request.priority) {
+        return REJECTED;
+    }
+    evicted = entries[lowest].request;
+    entries[lowest].request = request;
+    entries[lowest].seq = nextSeq++;
+    return REPLACED;
+}
+
+bool RfTxQueue::pop(RfTxRequest& request) {
+    if (count == 0) {
+        return false;
+    }
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < count; i++) {
+        const Entry& e = entries[i];
+        if (e.request.priority > entries[best].request.priority ||
+            (e.request.priority == entries[best].request.priority &&
+             (int32_t)(e.seq - entries[best].seq) < 0)) {
+            best = i;
+        }
+    }
+    request = entries[best].request;
+    // order lives in seq, so the last entry can simply fill the hole
+    entries[best] = entries[--count];
+    return true;
+}
+
+// Entry that goes last: lowest priority, newest within it
+int RfTxQueue::findLowest() const {
+    int lowest = 0;
+    for (uint8_t i = 1; i < count; i++) {
+        const Entry& e = entries[i];
+        if (e.request.priority < entries[lowest].request.priority ||
+            (e.request.priority == entries[lowest].request.priority &&
+             (int32_t)(e.seq - entries[lowest].seq) > 0)) {
+            lowest = i;
+        }
+    }
+    return lowest;
+}
@@ -0,0 +1,137 @@
+#include "Scheduler.h"
+
+#define WHEEL_MASK (SCHEDULER_WHEEL_SLOTS - 1)
+
+static_assert((SCHEDULER_WHEEL_SLOTS & WHEEL_MASK) == 0, "SCHEDULER_WHEEL_SLOTS must be a power of two");
+static_assert(SCHEDULER_MAX_TASKS < Scheduler::NO_TASK, "too many tasks for TaskId");
+
+Scheduler::Scheduler() : count(0), current(0), lastMs(0), late(0) {
+    for (uint16_t i = 0; i < SCHEDULER_WHEEL_SLOTS; i++) {
+        wheel[i] = NO_TASK;
+    }
+}
+
+uint32_t Scheduler::ticks(unsigned long ms) {
+    const uint32_t n = (ms + SCHEDULER_TICK_MS - 1) / SCHEDULER_TICK_MS;
+    return n ? n : 1;
+}
+
+Scheduler::TaskId Scheduler::add(Job job) {
+    if (count >= SCHEDULER_MAX_TASKS) {
+        return NO_TASK;
+    }
+    Task& t = tasks[count];
+    t.job = job;
+    t.due = 0;
+    t.period = 0;
+    t.next = NO_TASK;
+    t.state = IDLE;
+    return count++;
+}
+
+void Scheduler::after(TaskId task, unsigned long delayMs) {
+    if (task >= count) return;
+    tasks[task].period = 0;
+    schedule(task, current + ticks(delayMs));
+}
+
+void Scheduler::every(TaskId task, unsigned long periodMs) {
+    if (task >= count) return;
+    tasks[task].period = ticks(periodMs);
+    schedule(task, current + tasks[task].period);
+}
+
+void Scheduler::cancel(TaskId task) {
+    if (task >= count) return;
+    if (tasks[task].state == WAITING) {
+        unlink(task);
+    }
+    tasks[task].state = IDLE;
+}
+
+bool Scheduler::pending(TaskId task) const {
+    return task < count && tasks[task].state != IDLE;
+}
+
+void Scheduler::schedule(TaskId task, uint32_t due) {
+    Task& t = tasks[task];
+    if (t.state == WAITING) {
+        unlink(task);
+    }
+    TaskId& head = wheel[due & WHEEL_MASK];
+    t.due = due;
+    t.next = head;
+    t.state = WAITING;
+    head = task;
+}
+
+void Scheduler::unlink(TaskId task) {
+    TaskId* link = &wheel[tasks[task].due & WHEEL_MASK];
+    while (*link != NO_TASK) {
+        if (*link == task) {
+            *link = tasks[task].next;
+            return;
+        }
+        link = &tasks[*link].next;
+    }
+}
+
+void Scheduler::run(unsigned long now) {
+    const uint32_t elapsed = (now - lastMs) / SCHEDULER_TICK_MS;
+    if (elapsed == 0) {
+        return;
+    }
+    lastMs += elapsed * SCHEDULER_TICK_MS;
+    if (elapsed > 1) {
+        late++;
+    }
+    if (elapsed >= SCHEDULER_WHEEL_SLOTS) {
+        // a whole turn or more went by: one pass over every slot catches up
+        const uint32_t target = current + elapsed;
+        current = target;
+        for (uint16_t slot = 0; slot < SCHEDULER_WHEEL_SLOTS; slot++) {
+            advance(slot, target);
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < elapsed; i++) {
+        current++;
+        advance(current & WHEEL_MASK, current);
+    }
+}
+
+// Runs the tasks of one slot that are due by tick. The due ones are taken
+// off the wheel first, so a job may freely schedule or cancel any task,
+// including itself and others due in the same tick.
+void Scheduler::advance(uint16_t slot, uint32_t tick) {
+    TaskId ready[SCHEDULER_MAX_TASKS];
+    uint8_t readyCount = 0;
+    TaskId* link = &wheel[slot];
+    while (*link != NO_TASK) {
+        Task& t = tasks[*link];
+        if ((int32_t)(t.due - tick) <= 0) {
+            ready[readyCount++] = *link;
+            t.state = READY;
+            *link = t.next;
+        } else {
+            link = &t.next;
+        }
+    }
+
+    for (uint8_t i = 0; i < readyCount; i++) {
+        Task& t = tasks[ready[i]];
+        if (t.state != READY) {
+            continue;  // cancelled or rescheduled by an earlier job
+        }
+        t.state = IDLE;
+        if (t.period) {
+            // keep the period's phase, but skip runs that were missed
+            uint32_t next = t.due + t.period;
+            if ((int32_t)(next - current) <= 0) {
+                next = current + t.period;
+            }
+            schedule(ready[i], next);
+        }
+        t.job();
+    }
+}
@@ -0,0 +1,147 @@
+#include "StateLog.h"
+#include <string.h>
+
+#define STATE_LOG_SECTOR_SIZE FLASH_AREA_SECTOR_SIZE
+#define STATE_LOG_MAGIC 0xA5
+#define RECORDS_PER_SECTOR (STATE_LOG_SECTOR_SIZE / sizeof(Record))
+
+StateLog::StateLog(unsigned long commitDelayMs)
+    : commitDelay(commitDelayMs), area(), sector(0), slot(0),
+      sectorReady(false), seq(0), saved(0), haveSaved(false), pending(0),
+      dirty(false), dirtySince(0), commits(0), coalesced(0) {
+}
+
+bool StateLog::valid(const Record& record) {
+    return record.magic == STATE_LOG_MAGIC && record.seq != 0xFFFFFFFF &&
+           record.crc == flashCrc8((const uint8_t*)&record, sizeof(Record) - 1);
+}
+
+bool StateLog::readRecord(uint16_t sector, uint16_t slot, Record& record) const {
+    return area.read(sector * STATE_LOG_SECTOR_SIZE + slot * sizeof(Record),
+                     (uint32_t*)&record, sizeof(Record));
+}
+
+// First slot of the sector that was never written. Records are appended in
+// order, so the written slots form a prefix and a binary search will do.
+uint16_t StateLog::findFree(uint16_t sector) const {
+    uint16_t lo = 0;
+    uint16_t hi = RECORDS_PER_SECTOR;
+    while (lo < hi) {
+        const uint16_t mid = (lo + hi) / 2;
+        Record record;
+        const uint32_t* words = (const uint32_t*)&record;
+        if (!readRecord(sector, mid, record) || words[0] != 0xFFFFFFFF || words[1] != 0xFFFFFFFF) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool StateLog::begin(const FlashArea& flash) {
+    if (flash.sectors == 0) {
+        return false;
+    }
+    area = flash;
+
+    // The newest valid record ends the written part of its sector; a torn
+    // write after it is skipped by walking back.
+    haveSaved = false;
+    for (uint16_t s = 0; s < area.sectors; s++) {
+        const uint16_t free = findFree(s);
+        for (int i = (int)free - 1; i >= 0; i--) {
+            Record record;
+            if (readRecord(s, i, record) && valid(record)) {
+                if (!haveSaved || (int32_t)(record.seq - seq) > 0) {
+                    haveSaved = true;
+                    seq = record.seq;
+                    saved = record.state;
+                    sector = s;
+                    slot = free;
+                }
+                break;
+            }
+        }
+    }
+    // With no log yet the area may hold anything, so start on a fresh sector
+    sectorReady = haveSaved;
+    if (!haveSaved) {
+        sector = area.sectors - 1;
+        slot = RECORDS_PER_SECTOR;
+    }
+    return true;
+}
+
+bool StateLog::restore(uint16_t& state) const {
+    if (!haveSaved) {
+        return false;
+    }
+    state = saved;
+    return true;
+}
+
+void StateLog::save(uint16_t state, unsigned long now) {
+    if (dirty) {
+        coalesced++;
+    } else {
+        dirtySince = now;
+    }
+    pending = state;
+    dirty = true;
+}
+
+void StateLog::loop(unsigned long now) {
+    if (dirty && now - dirtySince >= commitDelay) {
+        flush();
+    }
+}
+
+void StateLog::flush() {
+    if (!dirty) {
+        return;
+    }
+    dirty = false;
+    if (haveSaved && pending == saved) {
+        return;  // toggled back and forth; nothing new to store
+    }
+    // a slot that does not read back correctly was not really erased;
+    // move on and try once more on a freshly erased sector
+    if (!append(pending)) {
+        sectorReady = false;
+        append(pending);
+    }
+}
+
+bool StateLog::append(uint16_t state) {
+    if (area.sectors == 0) {
+        return false;
+    }
+    if (!sectorReady || slot >= RECORDS_PER_SECTOR) {
+        sector = (sector + 1) % area.sectors;
+        slot = 0;
+        if (!area.erase(sector)) {
+            return false;
+        }
+        sectorReady = true;
+    }
+
+    Record record;
+    record.seq = seq + 1;
+    record.state = state;
+    record.magic = STATE_LOG_MAGIC;
+    record.crc = flashCrc8((const uint8_t*)&record, sizeof(Record) - 1);
+    const uint32_t offset = sector * STATE_LOG_SECTOR_SIZE + slot * sizeof(Record);
+    slot++;
+    Record check;
+    if (!area.write(offset, (const uint32_t*)&record, sizeof(Record)) ||
+        !area.read(offset, (uint32_t*)&check, sizeof(Record)) ||
+        memcmp(&record, &check, sizeof(Record)) != 0) {
+        return false;
+    }
+    seq = record.seq;
+    saved = state;
+    haveSaved = true;
+    commits++;
+    return true;
+}
@@ -2,9 +2,23 @@
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
 #include <RCSwitch.h>
-#include <map>
+#include <Payload.h>
 #include <WiFiManager.h> 
 #include <EEPROM.h>
+#include "RfTxQueue.h"
+#include "RfRatePolicy.h"
+#include "CommandParser.h"
+#include "SwitchBank.h"
+#include "StateLog.h"
+#include "RfEventStore.h"
+#include "Scheduler.h"
+#include "Backoff.h"
+
+// Codes travel as 32-bit values from here on: the send command (strtoul),
+// the published messages (%lu), RfEvent and the binary payload. A wider
+// RCSwitch::Code would be cut short without a word.
+static_assert(RCSWITCH_MAX_BITS <= 32, "codes are handled as 32-bit values; widen them before raising RCSWITCH_MAX_BITS");
+
 #define EEPROM_SIZE 10  // Allocate enough bytes to store switch states
 
 // ✅ WiFi Credentials
@@ -12,8 +26,10 @@
 // const char* password = "dmabd987";
 
 #define RESET_PIN 0  // GPIO 0 for WiFi reset
+#define RESET_HOLD_MS 5000    // Hold the button this long to clear the WiFi settings
+#define BUTTON_POLL_MS 50     // Also the debounce window
 unsigned long buttonPressTime = 0;
-bool resetFlag = false;
+bool buttonPressed = false;
 
 WiFiManager wm;
 
@@ -21,18 +37,29 @@ WiFiManager wm;
 #define DEBUG_PRINT(x)  if (DEBUG_MODE) { Serial.print(x); }
 #define DEBUG_PRINTLN(x) if (DEBUG_MODE) { Serial.println(x); }
 
-#define WIFI_ATTEMPT_COUNT 60
-#define WIFI_ATTEMPT_DELAY 1000
-#define WIFI_WAIT_COUNT 60
-#define WIFI_WAIT_DELAY 1000
-#define MAX_WIFI_ATTEMPTS 2
-#define MQTT_ATTEMPT_COUNT 10
-#define MQTT_ATTEMPT_DELAY 5000
-
-int wifiAttemptCount = WIFI_ATTEMPT_COUNT;
-int wifiWaitCount = WIFI_WAIT_COUNT;
-int maxWifiAttempts = MAX_WIFI_ATTEMPTS;
-int mqttAttemptCount = MQTT_ATTEMPT_COUNT;
+// ✅ Connection Manager: retries back off exponentially with jitter, so a
+// fleet that lost the broker together does not reconnect in lockstep
+#define WIFI_JOIN_TIMEOUT_MS 30000        // Give up on one WiFi join after this
+#define WIFI_BACKOFF_BASE_MS 5000
+#define WIFI_BACKOFF_MAX_MS (5 * 60000UL)
+#define MQTT_BACKOFF_BASE_MS 2000
+#define MQTT_BACKOFF_MAX_MS (5 * 60000UL)
+#define MQTT_SOCKET_TIMEOUT_S 5           // Bounds one blocking connect()
+#define MQTT_REJOIN_FAILURES 6            // Rejoin WiFi after this many failed MQTT attempts in a row
+#define LINK_RESTART_MS (60 * 60000UL)    // Last resort: restart after an hour offline
+
+enum LinkState {
+    LINK_WIFI_IDLE,    // waiting to (re)join WiFi
+    LINK_WIFI_JOIN,    // joining WiFi
+    LINK_MQTT_IDLE,    // on WiFi, waiting to try the broker
+    LINK_ONLINE,
+};
+LinkState linkState = LINK_WIFI_IDLE;
+unsigned long linkSince = 0;      // when linkState was entered
+unsigned long linkWait = 0;       // how long to stay in an IDLE state
+unsigned long offlineSince = 0;
+Backoff wifiBackoff(WIFI_BACKOFF_BASE_MS, WIFI_BACKOFF_MAX_MS);
+Backoff mqttBackoff(MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_MAX_MS);
 
 // ✅ MQTT Configuration
 const char* mqtt_server = "broker2.dma-bd.com";
@@ -41,6 +68,13 @@ const char* mqtt_password = "Secret!@#$1234";
 const char* mqtt_pub_topic = "DMA/SmartSwitch/PUB";
 const char* mqtt_sub_topic = "DMA/SmartSwitch/SUB";
 const char* mqtt_hb_topic = "DMA/SmartSwitch/HB";
+const char* mqtt_rftx_topic = "DMA/SmartSwitch/RFTX";
+const char* mqtt_bin_topic = "DMA/SmartSwitch/BIN";
+
+// ✅ Binary Payload (lib/payload): when enabled, every message goes out in
+// binary on mqtt_bin_topic instead of as CSV; tools/payload decodes it
+#define MQTT_BINARY_PAYLOAD false
+#define PAYLOAD_BUFFER_SIZE 256
 
 // ✅ Device ID
 #define WORK_PACKAGE "1225"
@@ -48,285 +82,612 @@ const char* mqtt_hb_topic = "DMA/SmartSwitch/HB";
 #define FIRMWARE_UPDATE_DATE "250212" 
 #define DEVICE_SERIAL "0006"
 #define DEVICE_ID WORK_PACKAGE GW_TYPE FIRMWARE_UPDATE_DATE DEVICE_SERIAL
+uint64_t deviceNumber = 0;  // DEVICE_ID as an integer, for binary payloads
 
 #define HB_INTERVAL 5*60*1000
 
 // ✅ Pin Definitions
 #define RF433_RX_PIN 5  // GPIO5 (D1) - RF Receiver Data Pin
+#define RF433_TX_PIN 16 // GPIO16 (D0) - RF Transmitter Data Pin
 #define LED_PIN 2       // GPIO2 (D4) - LED Control
 #define SW1_PIN 14       // GPIO4 (D2)
 #define SW2_PIN 13      // GPIO13 (D7)
 #define SW3_PIN 12      // GPIO14 (D5)
 #define SW4_PIN 4      // GPIO15 (D8)
 
+// ✅ Relay Outputs: channel n is switch n+1 and bit n of the saved state
+typedef SwitchBank<SW1_PIN, SW2_PIN, SW3_PIN, SW4_PIN> Switches;
+Switches switches;
+#define STATE_COMMIT_DELAY_MS 2000  // Commands within this time of the first change share one flash write
+StateLog stateLog(STATE_COMMIT_DELAY_MS);
+
+// ✅ Flash Layout: sectors of the 64 KB filesystem area
+#define STATE_LOG_FIRST_SECTOR 0
+#define STATE_LOG_SECTORS 4
+#define RF_EVENT_FIRST_SECTOR 4
+#define RF_EVENT_SECTORS 12          // 3072 events
+
+// ✅ RF433 Noise Suppression
+#define RF_MIN_PULSE_US 80       // Shorter pulses are noise spikes (shortest real pulse is 150us)
+#define RF_MAX_EDGES 40          // Edges allowed per RF_EDGE_WINDOW_US before the receiver backs off
+#define RF_EDGE_WINDOW_US 2000
+#define RF_EDGE_MASK_US 50000    // Receiver pause once the edge budget is exceeded
+
+// ✅ RF433 Transmit Bridge
+#define RF_TX_DEFAULT_REPEATS 10
+#define RF_TX_MAX_REPEATS 30
+#define RF_TX_GUARD_US 150000    // Quiet time after the last received frame before we transmit
+#define RF_TX_MAX_DEFER_MS 2000  // Transmit anyway if the air has not gone quiet by then
+
 // ✅ RF433 & MQTT Setup
 RCSwitch mySwitch = RCSwitch();
 WiFiClient espClient;
 PubSubClient client(espClient);
 
-// ✅ Debounce Variables
-unsigned long lastRFGlobalReceivedTime = 0;
-std::map<unsigned long, unsigned long> lastRFReceivedTimeMap;
+// ✅ Publish Rate Policy
+#define RF_CODE_BURST 1             // Each sensor: 1 report, then one more per interval
+#define RF_CODE_INTERVAL_MS 2000
+#define RF_PUBLISH_BURST 8          // All sensors together: 8 at once, then one per interval; more wait in rfEvents
+#define RF_PUBLISH_INTERVAL_MS 250
+RfRatePolicy rfRatePolicy({ RF_CODE_BURST, RF_CODE_INTERVAL_MS }, { RF_PUBLISH_BURST, RF_PUBLISH_INTERVAL_MS });
+
+// ✅ Cooperative Tasks: nothing in the loop may delay(), so RF frames and
+// MQTT messages are handled as soon as they arrive
+Scheduler scheduler;
+Scheduler::TaskId ledTask;
+Scheduler::TaskId buttonTask;
+Scheduler::TaskId heartbeatTask;
+
+// ✅ RF Event Store: received codes wait here while the broker is away
+#define RF_REPLAY_BURST 10           // Messages published back to back after a reconnect
+#define RF_REPLAY_INTERVAL_MS 50     // then one per interval
+#define RF_BATCH_WINDOW_MS 250       // An event waits at most this long for others to share its message
+#define RF_BATCH_MAX 12              // Events per message
+#define RF_BATCH_PAYLOAD_SIZE 400
+#define MQTT_BUFFER_SIZE 512         // Topic and payload of the largest message
+RfEventStore rfEvents;
+unsigned long rfReplayTat = 0;
+bool rfHeld = false;                 // An unconfirmed low latency frame is waiting for its repeat
+unsigned long rfHeldSince = 0;
+
+// ✅ RF Transmit Queue
+RfTxQueue rfTxQueue;
+RfTxRequest rfTxCurrent;
+bool rfTxDeferred = false;
+unsigned long rfTxDeferredSince = 0;
+
+// Saves what is still held in RAM, then restarts
+void restartDevice() {
+    stateLog.flush();
+    rfEvents.persist();
+    ESP.restart();
+}
+
+// ✅ Status LED: short LOW pulses, then HIGH while online
+uint8_t ledPulsesLeft = 0;
+uint16_t ledLowMs = 0;
+uint16_t ledGapMs = 0;
 
-void resetWiFi() {
-    if (digitalRead(RESET_PIN) == LOW) {  // Button pressed
-        DEBUG_PRINTLN("Button Pressed... Waiting for 5 seconds");
-
-        unsigned long pressStart = millis();
-        while (millis() - pressStart < 5000) {  // Wait for 5 seconds
-            if (digitalRead(RESET_PIN) == HIGH) {  
-                DEBUG_PRINTLN("Button Released... Canceling Reset.");
-                return;  // Exit if the button is released early
-            }
-            delay(100);
+void ledBlink(uint8_t pulses, uint16_t lowMs, uint16_t gapMs) {
+    ledPulsesLeft = pulses;
+    ledLowMs = lowMs;
+    ledGapMs = gapMs;
+    digitalWrite(LED_PIN, LOW);
+    scheduler.after(ledTask, lowMs);
+}
+
+void ledStep() {
+    if (digitalRead(LED_PIN) == LOW) {
+        digitalWrite(LED_PIN, HIGH);
+        if (--ledPulsesLeft == 0) {
+            digitalWrite(LED_PIN, client.connected() ? HIGH : LOW);
+        } else {
+            scheduler.after(ledTask, ledGapMs);
         }
+    } else {
+        digitalWrite(LED_PIN, LOW);
+        scheduler.after(ledTask, ledLowMs);
+    }
+}
+
+void resetWiFi() {
+    DEBUG_PRINTLN("Resetting WiFi...");
+    switches.restore(0);  // All off
+    wm.resetSettings();  // Clear saved WiFi credentials
+    wm.autoConnect("DMA_Smart_Switch");
+    restartDevice();
+}
 
-        DEBUG_PRINTLN("Resetting WiFi...");
-        digitalWrite(SW1_PIN, LOW);
-        digitalWrite(SW2_PIN, LOW);
-        digitalWrite(SW3_PIN, LOW);
-        digitalWrite(SW4_PIN, LOW);
-        wm.resetSettings();  // Clear saved WiFi credentials
-        wm.autoConnect("DMA_Smart_Switch");
-        ESP.restart();       // Restart ESP
+// Polled every BUTTON_POLL_MS; a press held for RESET_HOLD_MS resets WiFi
+void pollResetButton() {
+    if (digitalRead(RESET_PIN) == LOW) {
+        if (!buttonPressed) {
+            buttonPressed = true;
+            buttonPressTime = millis();
+            DEBUG_PRINTLN("Button Pressed... Hold for 5 seconds");
+        } else if (millis() - buttonPressTime >= RESET_HOLD_MS) {
+            resetWiFi();
+        }
+    } else if (buttonPressed) {
+        buttonPressed = false;
+        DEBUG_PRINTLN("Button Released... Canceling Reset.");
     }
 }
 
 
-// Function to reconnect to WiFi
-void reconnectWiFi() {
-    int attempt = 0;
+uint32_t jitter() {
+    return (uint32_t)random(0x7FFFFFFF);
+}
+
+void linkEnter(LinkState state, unsigned long wait) {
+    linkState = state;
+    linkSince = millis();
+    linkWait = wait;
+}
+
+void linkJoinWiFi() {
     DEBUG_PRINTLN("Connecting to WiFi...");
     // WiFi.begin(ssid, password);
     WiFi.begin();  // Use saved credentials
-    while (WiFi.status() != WL_CONNECTED && attempt < WIFI_ATTEMPT_COUNT) {
-        DEBUG_PRINT("Remaining WiFi Attempt: ");
-        DEBUG_PRINTLN(WIFI_ATTEMPT_COUNT - attempt - 1);
-        delay(WIFI_ATTEMPT_DELAY);
-        attempt++;
-        if (digitalRead(RESET_PIN) == LOW){
-            resetWiFi();
+    linkEnter(LINK_WIFI_JOIN, WIFI_JOIN_TIMEOUT_MS);
+}
+
+// Leaves the network but keeps the saved credentials, which a plain
+// disconnect() would erase
+void linkDropWiFi() {
+    WiFi.disconnect(false, false);
+}
+
+void linkWiFiLost() {
+    DEBUG_PRINTLN("WiFi connection lost");
+    linkEnter(LINK_WIFI_JOIN, WIFI_JOIN_TIMEOUT_MS);  // the SDK rejoins by itself
+}
+
+// One attempt; connect() blocks for at most MQTT_SOCKET_TIMEOUT_S
+bool linkConnectMQTT() {
+    char clientId[24];
+    snprintf(clientId, sizeof(clientId), "dma_ssw_%04X%04X%04X", random(0xffff), random(0xffff), random(0xffff));
+    DEBUG_PRINTLN("Attempting MQTT connection...");
+    if (!client.connect(clientId, mqtt_user, mqtt_password)) {
+        DEBUG_PRINT("MQTT connection failed, state ");
+        DEBUG_PRINTLN(client.state());
+        return false;
+    }
+    DEBUG_PRINTLN("MQTT connected");
+    DEBUG_PRINT("MQTT Client ID: ");
+    DEBUG_PRINTLN(clientId);
+
+    char topic[48];
+    snprintf(topic, sizeof(topic), "%s/%s", mqtt_sub_topic, DEVICE_ID);
+    client.subscribe(topic);
+    snprintf(topic, sizeof(topic), "%s/%s", mqtt_rftx_topic, DEVICE_ID);
+    client.subscribe(topic);
+    // client.subscribe(mqtt_sub_topic);
+    return true;
+}
+
+// ✅ Connection state machine, stepped once per loop without blocking
+void serviceLink() {
+    const unsigned long now = millis();
+    const bool wifiUp = WiFi.status() == WL_CONNECTED;
+
+    if (linkState != LINK_ONLINE && now - offlineSince >= LINK_RESTART_MS) {
+        DEBUG_PRINTLN("Offline for too long, restarting...");
+        restartDevice();
+    }
+
+    switch (linkState) {
+    case LINK_WIFI_IDLE:
+        if (now - linkSince >= linkWait) {
+            linkJoinWiFi();
+        }
+        break;
+
+    case LINK_WIFI_JOIN:
+        if (wifiUp) {
+            DEBUG_PRINTLN("WiFi Connected!");
+            wifiBackoff.reset();
+            // spread the first broker attempt, e.g. after a site-wide power cut
+            linkEnter(LINK_MQTT_IDLE, mqttBackoff.failures() ? 0 : mqttBackoff.first(jitter()));
+        } else if (now - linkSince >= linkWait) {
+            linkDropWiFi();
+            unsigned long wait = wifiBackoff.next(jitter());
+            DEBUG_PRINTLN(String("WiFi connection failed, retrying in ") + String(wait / 1000) + " s");
+            linkEnter(LINK_WIFI_IDLE, wait);
+        }
+        break;
+
+    case LINK_MQTT_IDLE:
+        if (!wifiUp) {
+            linkWiFiLost();
+        } else if (now - linkSince >= linkWait) {
+            if (linkConnectMQTT()) {
+                mqttBackoff.reset();
+                digitalWrite(LED_PIN, HIGH);
+                linkEnter(LINK_ONLINE, 0);
+            } else {
+                unsigned long wait = mqttBackoff.next(jitter());
+                DEBUG_PRINTLN(String("Retrying MQTT in ") + String(wait / 1000) + " s");
+                if (mqttBackoff.failures() % MQTT_REJOIN_FAILURES == 0) {
+                    // maybe the fault is on our side: join WiFi afresh first
+                    linkDropWiFi();
+                    linkEnter(LINK_WIFI_IDLE, wait);
+                } else {
+                    linkEnter(LINK_MQTT_IDLE, wait);
+                }
+            }
+        }
+        break;
+
+    case LINK_ONLINE:
+        if (client.connected()) {
+            offlineSince = now;
             break;
         }
+        digitalWrite(LED_PIN, LOW);
+        if (!wifiUp) {
+            linkWiFiLost();
+        } else {
+            DEBUG_PRINTLN("MQTT connection lost");
+            linkEnter(LINK_MQTT_IDLE, mqttBackoff.first(jitter()));
+        }
+        break;
     }
+}
 
-    if (WiFi.status() == WL_CONNECTED) {
-        DEBUG_PRINTLN("WiFi Connected!");
-    } else {
-        DEBUG_PRINTLN("WiFi connection failed, retrying...");
 
-        for (int waitAttempt = 0; waitAttempt < WIFI_WAIT_COUNT; waitAttempt++) {
-            delay(WIFI_WAIT_DELAY);
-            
-            if (digitalRead(RESET_PIN) == LOW){
-                resetWiFi();
-                break;
-            }
+// ✅ Binary Messages
+bool publishBinary(PayloadMessage& message) {
+    uint8_t bytes[PAYLOAD_BUFFER_SIZE];
+    message.device = deviceNumber;
+    const size_t size = payloadEncode(message, bytes, sizeof(bytes));
+    return size > 0 && client.publish(mqtt_bin_topic, bytes, size);
+}
 
-            if (WiFi.status() == WL_CONNECTED) {
-                DEBUG_PRINTLN("WiFi Connected during wait time!");
-                return;
-            }
+// "id,rftx:code" once sent, "id,rftx:code:busy" if it was dropped (queue
+// full, or the transmitter refused it)
+void publishRfTx(RCSwitch::Code code, bool busy) {
+    if (MQTT_BINARY_PAYLOAD) {
+        PayloadMessage message;
+        message.type = PAYLOAD_RF_TX;
+        message.code = code;
+        message.status = busy;
+        publishBinary(message);
+        return;
+    }
+    char data[48];
+    snprintf(data, sizeof(data), "%s,rftx:%lu%s", DEVICE_ID, (unsigned long)code, busy ? ":busy" : "");
+    client.publish(mqtt_pub_topic, data);
+}
+
+// ✅ Queue an RF transmission: "code,bits,protocol[,repeats[,priority]]"
+void handleRfTxCommand(const byte* payload, unsigned int length) {
+    char text[48];
+    if (length >= sizeof(text)) {
+        DEBUG_PRINTLN("RF TX command too long");
+        return;
+    }
+    memcpy(text, payload, length);
+    text[length] = '\0';
+
+    char* field = text;
+    unsigned long values[5] = { 0, 0, 0, RF_TX_DEFAULT_REPEATS, 0 };
+    int count = 0;
+    while (count < 5) {
+        char* end;
+        values[count++] = strtoul(field, &end, 0);
+        if (end == field || (*end != ',' && *end != '\0')) {
+            count = 0;
+            break;
         }
+        if (*end == '\0') break;
+        field = end + 1;
+    }
+    if (count < 3 || values[1] < 1 || values[1] > RCSWITCH_MAX_BITS ||
+        values[2] < 1 || values[2] > (unsigned long)RCSwitch::getProtocolCount() ||
+        values[3] < 1 || values[3] > RF_TX_MAX_REPEATS || values[4] > 255) {
+        DEBUG_PRINTLN(String("Bad RF TX command: ") + text);
+        return;
+    }
+
+    RfTxRequest request;
+    request.code = values[0];
+    request.bits = values[1];
+    request.protocol = values[2];
+    request.repeats = values[3];
+    request.priority = values[4];
+    RfTxRequest evicted;
+    RfTxQueue::Result result = rfTxQueue.push(request, evicted);
+    if (result == RfTxQueue::REJECTED) {
+        DEBUG_PRINTLN("RF TX queue full, command dropped");
+        publishRfTx(request.code, true);
+    } else if (result == RfTxQueue::REPLACED) {
+        DEBUG_PRINTLN(String("RF TX queue full, dropped pending: ") + String((unsigned long)evicted.code));
+        publishRfTx(evicted.code, true);
+    }
+}
+
+void rfTxComplete() {
+    DEBUG_PRINTLN(String("RF Sent: ") + String((unsigned long)rfTxCurrent.code));
+    publishRfTx(rfTxCurrent.code, false);
+}
+
+// ✅ Start the next queued RF transmission once the receiver is idle
+void serviceRfTx() {
+    if (mySwitch.isTransmitting() || rfTxQueue.empty()) {
+        return;
+    }
+    // Our transmitter would blind the receiver, so wait until the sender on
+    // the air has stopped repeating; a sender that never stops only delays us
+    bool rxBusy = mySwitch.getPendingFrames() > 0 ||
+                  micros() - mySwitch.getLastFrameTime() < RF_TX_GUARD_US;
+    if (rxBusy) {
+        if (!rfTxDeferred) {
+            rfTxDeferred = true;
+            rfTxDeferredSince = millis();
+        }
+        if (millis() - rfTxDeferredSince < RF_TX_MAX_DEFER_MS) {
+            return;
+        }
+    }
+    rfTxDeferred = false;
+
+    rfTxQueue.pop(rfTxCurrent);
+    mySwitch.setProtocol(rfTxCurrent.protocol);
+    mySwitch.setRepeatTransmit(rfTxCurrent.repeats);
+    // Nothing else is transmitting, so a refusal will not go away by
+    // retrying (no transmitter, or a code too long); report it as dropped
+    if (!mySwitch.sendAsync(rfTxCurrent.code, rfTxCurrent.bits)) {
+        DEBUG_PRINTLN(String("RF TX failed: ") + String((unsigned long)rfTxCurrent.code));
+        publishRfTx(rfTxCurrent.code, true);
+    }
+}
 
-        maxWifiAttempts--;
-        if (maxWifiAttempts <= 0) {
-            DEBUG_PRINTLN("Max WiFi attempt cycles exceeded, restarting...");
-            ESP.restart();
+// ✅ Switch State Persistence
+// Older firmware kept the states at EEPROM addresses 0..3; read them once
+// until the state log has a record of its own.
+void restoreSwitchStates() {
+    Switches::Mask state = 0;
+    if (!stateLog.begin(flashArea(STATE_LOG_FIRST_SECTOR, STATE_LOG_SECTORS)) || !stateLog.restore(state)) {
+        EEPROM.begin(EEPROM_SIZE);
+        for (uint8_t i = 0; i < Switches::size(); i++) {
+            if (EEPROM.read(i) == 1) state |= 1 << i;
         }
+        EEPROM.end();
     }
+    switches.restore(state);
 }
 
+// ✅ RF Event Publishing
+// A lone event that is still fresh goes out as "id,code", as always.
+// Anything else is one batch:
+//   id,rfb:<seq>:<age>,<code>:<bits>:<protocol>:<dt>,...
+// seq numbers the first event, the rest follow on; age is how many ms ago
+// the first event was received (empty for events from before a restart)
+// and dt how many ms after the first event each one was.
+bool publishRfEvents(const RfEvent* events, unsigned int& count, unsigned long now) {
+    const bool fresh = rfEvents.fromThisBoot(events[0]);
+    if (MQTT_BINARY_PAYLOAD) {
+        PayloadMessage message;
+        message.type = PAYLOAD_RF_EVENTS;
+        message.seq = events[0].seq;
+        message.age = fresh ? now - events[0].time : PAYLOAD_AGE_UNKNOWN;
+        message.eventCount = count;
+        for (unsigned int i = 0; i < count; i++) {
+            message.events[i].code = events[i].code;
+            message.events[i].bits = events[i].bits;
+            message.events[i].protocol = events[i].protocol;
+            message.events[i].dt = events[i].time - events[0].time;
+        }
+        if (!publishBinary(message)) {
+            return false;
+        }
+        ledBlink(2, 50, 50);
+        return true;
+    }
 
-// Function to reconnect MQTT
-void reconnectMQTT() {
-    char clientId[24];
-    snprintf(clientId, sizeof(clientId), "dma_ssw_%04X%04X%04X", random(0xffff), random(0xffff), random(0xffff));
-    DEBUG_PRINTLN("Attempting MQTT connection...");
-    int attempt = 0;
-    while (attempt < MQTT_ATTEMPT_COUNT) {
-        if (client.connect(clientId, mqtt_user, mqtt_password)) {
-            DEBUG_PRINTLN("MQTT connected");
-            DEBUG_PRINT("MQTT Client ID: ");
-            DEBUG_PRINT(clientId);
-            
-            char topic[48];
-            snprintf(topic, sizeof(topic), "%s/%s", mqtt_sub_topic, DEVICE_ID);
-            client.subscribe(topic);
-
-            // client.subscribe(mqtt_sub_topic);
-            digitalWrite(LED_PIN, HIGH);
-            if (digitalRead(RESET_PIN) == LOW){
-                resetWiFi();
+    char data[RF_BATCH_PAYLOAD_SIZE];
+    if (count == 1 && fresh && now - events[0].time < RF_BATCH_WINDOW_MS * 2) {
+        snprintf(data, sizeof(data), "%s,%lu", DEVICE_ID, (unsigned long)events[0].code);
+    } else {
+        int pos = fresh ?
+            snprintf(data, sizeof(data), "%s,rfb:%lu:%lu", DEVICE_ID, (unsigned long)events[0].seq, now - events[0].time) :
+            snprintf(data, sizeof(data), "%s,rfb:%lu:", DEVICE_ID, (unsigned long)events[0].seq);
+        unsigned int n = 0;
+        while (n < count) {
+            const RfEvent& event = events[n];
+            int len = snprintf(data + pos, sizeof(data) - pos, ",%lu:%u:%u:%lu", (unsigned long)event.code,
+                               event.bits, event.protocol, (unsigned long)(event.time - events[0].time));
+            if (len < 0 || pos + len >= (int)sizeof(data)) {
+                data[pos] = '\0';  // the rest goes in the next message
+                break;
             }
+            pos += len;
+            n++;
+        }
+        count = n;
+    }
+    if (!client.publish(mqtt_pub_topic, data)) {
+        return false;
+    }
+    DEBUG_PRINTLN(String("Data Sent to MQTT: ") + String(data));
+    ledBlink(2, 50, 50);
+    return true;
+}
+
+// Publishes stored events in order while online, up to RF_BATCH_MAX per
+// message. A message goes out once it is full or its first event has
+// waited RF_BATCH_WINDOW_MS; a backlog from an outage goes out at once.
+// A token bucket (GCRA, as in RfRatePolicy) spaces out the messages.
+void serviceRfEvents() {
+    if (linkState != LINK_ONLINE) {
+        return;
+    }
+    const unsigned long now = millis();
+    RfEvent events[RF_BATCH_MAX];
+    while (!rfEvents.empty()) {
+        if ((long)(rfReplayTat - now) > (long)(RF_REPLAY_BURST - 1) * RF_REPLAY_INTERVAL_MS) {
             return;
-        } else {
-            DEBUG_PRINTLN("MQTT connection failed");
-            DEBUG_PRINT("Remaining MQTT attempts: ");
-            DEBUG_PRINTLN(MQTT_ATTEMPT_COUNT - attempt - 1);
-            attempt++;
-            delay(MQTT_ATTEMPT_DELAY);
-
-            if (digitalRead(RESET_PIN) == LOW){
-                resetWiFi();
-            }
         }
+        unsigned int count = rfEvents.peek(events, RF_BATCH_MAX);
+        if (count == 0) {
+            return;
+        }
+        if (count < RF_BATCH_MAX && rfEvents.fromThisBoot(events[0]) &&
+            now - events[0].time < RF_BATCH_WINDOW_MS) {
+            return;  // window still open
+        }
+        if (!publishRfEvents(events, count, now)) {
+            return;
+        }
+        rfEvents.pop(count);
+        rfReplayTat = ((long)(rfReplayTat - now) > 0 ? rfReplayTat : now) + RF_REPLAY_INTERVAL_MS;
     }
+}
 
-    DEBUG_PRINTLN("Max MQTT attempts exceeded, restarting...");
-    ESP.restart();
+// ✅ MQTT Command Handlers, indexed by Command::Type
+void handleSwitchCommand(const Command& command) {
+    if (command.mask & ~Switches::all()) {
+        DEBUG_PRINTLN("No such switch");
+        return;
+    }
+    // Reply with the canonical form of the command, e.g. "sw13:1"
+    char name[8 + COMMAND_MAX_SWITCHES];
+    int pos = 0;
+    name[pos++] = 's';
+    name[pos++] = 'w';
+    for (uint8_t i = 0; i < Switches::size(); i++) {
+        if (command.mask & (1 << i)) {
+            name[pos++] = '1' + i;
+        }
+    }
+    switches.apply(command.mask, command.value);
+    stateLog.save(switches.snapshot(), millis());
+    name[pos++] = ':';
+    name[pos++] = '0' + command.value;
+    name[pos] = '\0';
+    DEBUG_PRINTLN(String("Switch: ") + name);
+
+    if (MQTT_BINARY_PAYLOAD) {
+        PayloadMessage message;
+        message.type = PAYLOAD_SWITCH;
+        message.mask = command.mask;
+        message.value = command.value;
+        message.state = switches.snapshot();
+        publishBinary(message);
+        return;
+    }
+    char data[sizeof(DEVICE_ID) + sizeof(name)];  // id, comma, name
+    snprintf(data, sizeof(data), "%s,%s", DEVICE_ID, name);
+    client.publish(mqtt_pub_topic, data);
+}
+
+// "id,ssid,ip,rssi,heartbeat interval", sent for pings and as the heartbeat
+void publishStatus(const char* topic) {
+    if (MQTT_BINARY_PAYLOAD) {
+        PayloadMessage message;
+        const IPAddress ip = WiFi.localIP();
+        message.type = PAYLOAD_STATUS;
+        message.state = switches.snapshot();
+        message.rssi = WiFi.RSSI();
+        message.interval = HB_INTERVAL;
+        for (uint8_t i = 0; i < 4; i++) {
+            message.ip[i] = ip[i];
+        }
+        strncpy(message.ssid, WiFi.SSID().c_str(), PAYLOAD_MAX_SSID);
+        message.ssid[PAYLOAD_MAX_SSID] = '\0';
+        publishBinary(message);
+        return;
+    }
+    char status[100];
+    snprintf(status, sizeof(status), "%s,%s,%s,%d,%d",
+    DEVICE_ID, WiFi.SSID().c_str(),
+    WiFi.localIP().toString().c_str(), WiFi.RSSI(), HB_INTERVAL);
+    client.publish(topic, status);
+
+    DEBUG_PRINT("Sent status to MQTT: ");
+    DEBUG_PRINTLN(status);
 }
 
+void handlePingCommand(const Command&) {
+    DEBUG_PRINTLN("Request for ping");
+    publishStatus(mqtt_pub_topic);
+}
+
+void heartbeat() {
+    if (client.connected()) {
+        publishStatus(mqtt_hb_topic);
+    }
+}
+
+// Per-code rate override for hold-to-repeat remotes, burst 0 clears it
+void handleRateCommand(const Command& command) {
+    unsigned long rateCode = command.args[0];
+    RfRateRule rule = { (uint8_t)command.args[1], (uint16_t)command.args[2] };
+    bool ok = command.args[1] <= 255 && command.args[2] <= 65535 && rfRatePolicy.setOverride(rateCode, rule);
+    DEBUG_PRINTLN(String("Rate override for ") + String(rateCode) + (ok ? " set" : " rejected"));
+    if (MQTT_BINARY_PAYLOAD) {
+        PayloadMessage message;
+        message.type = PAYLOAD_RATE;
+        message.code = rateCode;
+        message.status = !ok;
+        publishBinary(message);
+        return;
+    }
+    char data[48];
+    snprintf(data, sizeof(data), "%s,rate:%lu:%s", DEVICE_ID, rateCode, ok ? "ok" : "error");
+    client.publish(mqtt_pub_topic, data);
+}
+
+typedef void (*CommandHandler)(const Command& command);
+const CommandHandler commandHandlers[Command::TYPE_COUNT] = {
+    handleSwitchCommand,  // Command::SWITCH
+    handlePingCommand,    // Command::PING
+    handleRateCommand,    // Command::RATE
+};
 
 // ✅ Handle Incoming MQTT Messages
 void callback(char* topic, byte* payload, unsigned int length) {
-    payload[length] = '\0';  // Null-terminate payload
-    String message = String((char*)payload);
-    DEBUG_PRINT("Received Message: ");
-    DEBUG_PRINTLN(message);
-    digitalWrite(LED_PIN, LOW);
-    delay(100);
-    digitalWrite(LED_PIN, HIGH);
-    delay(50);
-    
-    if (message == "sw1:0") {
-        digitalWrite(SW1_PIN, LOW);
-        DEBUG_PRINTLN("Switch-1: off");
-        EEPROM.write(0, 0);  // Store in EEPROM
-        EEPROM.commit();  // Save changes
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw1:0", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-    else if (message == "sw1:1") {
-        digitalWrite(SW1_PIN, HIGH);
-        DEBUG_PRINTLN("Switch-1: on");
-        EEPROM.write(0, 1);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw1:1", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-    else if (message == "sw2:0") {
-        digitalWrite(SW2_PIN, LOW);
-        DEBUG_PRINTLN("Switch-2: off");
-        EEPROM.write(1, 0);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw2:0", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-    else if (message == "sw2:1") {
-        digitalWrite(SW2_PIN, HIGH);
-        DEBUG_PRINTLN("Switch-2: on");
-        EEPROM.write(1, 1);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw2:1", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-    else if (message == "sw3:0") {
-        digitalWrite(SW3_PIN, LOW);
-        DEBUG_PRINTLN("Switch-3: off");
-        EEPROM.write(2, 0);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw3:0", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-    else if (message == "sw3:1") {
-        digitalWrite(SW3_PIN, HIGH);
-        DEBUG_PRINTLN("Switch-3: on");
-        EEPROM.write(2, 1);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw3:1", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-    else if (message == "sw4:0") {
-        digitalWrite(SW4_PIN, LOW);
-        DEBUG_PRINTLN("Switch-4: off");
-        EEPROM.write(3, 0);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw4:0", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-    else if (message == "sw4:1") {
-        digitalWrite(SW4_PIN, HIGH);
-        DEBUG_PRINTLN("Switch-4: on");
-        EEPROM.write(3, 1);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw4:1", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    }   
-    // Turn Off all of Switches
-    else if (message == "sw1234:0") {
-        digitalWrite(SW1_PIN, LOW);
-        digitalWrite(SW2_PIN, LOW);
-        digitalWrite(SW3_PIN, LOW);
-        digitalWrite(SW4_PIN, LOW);
-        DEBUG_PRINTLN("Switch-All: off");
-        EEPROM.write(0, 0);
-        EEPROM.write(1, 0);
-        EEPROM.write(2, 0);
-        EEPROM.write(3, 0);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw1234:0", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
+    if (strncmp(topic, mqtt_rftx_topic, strlen(mqtt_rftx_topic)) == 0) {
+        handleRfTxCommand(payload, length);
+        return;
     }
-    // Turn On all of Switches
-    else if (message == "sw1234:1") {
-        digitalWrite(SW1_PIN, HIGH);
-        digitalWrite(SW2_PIN, HIGH);
-        digitalWrite(SW3_PIN, HIGH);
-        digitalWrite(SW4_PIN, HIGH);
-        DEBUG_PRINTLN("Switch-All: on");
-        EEPROM.write(0, 1);
-        EEPROM.write(1, 1);
-        EEPROM.write(2, 1);
-        EEPROM.write(3, 1);
-        EEPROM.commit();
-        char data[32];
-        snprintf(data, sizeof(data), "%s,sw1234:1", DEVICE_ID);
-        client.publish(mqtt_pub_topic, data);
-    } 
-
-    if (message == "ping") {
-        DEBUG_PRINTLN("Request for ping");
-        char pingData[100]; // Increased size for additional info
-        snprintf(pingData, sizeof(pingData), "%s,%s,%s,%d,%d",
-        DEVICE_ID, WiFi.SSID().c_str(),
-        WiFi.localIP().toString().c_str(), WiFi.RSSI(), HB_INTERVAL);
-        client.publish(mqtt_pub_topic, pingData);
-    
-        DEBUG_PRINT("Sent ping response to MQTT: ");
-        DEBUG_PRINTLN(pingData);
+    if (DEBUG_MODE) {
+        Serial.print("Received Message: ");
+        Serial.write(payload, length);
+        Serial.println();
     }
-    
+    ledBlink(1, 100, 50);
+
+    Command command;
+    if (!parseCommand(payload, length, command)) {
+        DEBUG_PRINTLN("Unknown command");
+        return;
+    }
+    commandHandlers[command.type](command);
 }
 
 // ✅ Setup Function
 void setup() {
     Serial.begin(74880);
+    deviceNumber = strtoull(DEVICE_ID, 0, 10);
     pinMode(LED_PIN, OUTPUT);
     digitalWrite(LED_PIN, LOW);
-    pinMode(SW1_PIN, OUTPUT);
-    pinMode(SW2_PIN, OUTPUT);
-    pinMode(SW3_PIN, OUTPUT);
-    pinMode(SW4_PIN, OUTPUT);
+    switches.begin();
 
     pinMode(RESET_PIN, INPUT_PULLUP);
 
-    EEPROM.begin(EEPROM_SIZE);  // Initialize EEPROM
+    ledTask = scheduler.add(ledStep);
+    buttonTask = scheduler.add(pollResetButton);
+    heartbeatTask = scheduler.add(heartbeat);
+    scheduler.every(buttonTask, BUTTON_POLL_MS);
+    scheduler.every(heartbeatTask, HB_INTERVAL);
 
     // Restore switch states
-    digitalWrite(SW1_PIN, EEPROM.read(0) ? HIGH : LOW);
-    digitalWrite(SW2_PIN, EEPROM.read(1) ? HIGH : LOW);
-    digitalWrite(SW3_PIN, EEPROM.read(2) ? HIGH : LOW);
-    digitalWrite(SW4_PIN, EEPROM.read(3) ? HIGH : LOW);
+    restoreSwitchStates();
+    if (rfEvents.begin(flashArea(RF_EVENT_FIRST_SECTOR, RF_EVENT_SECTORS)) && !rfEvents.empty()) {
+        DEBUG_PRINTLN(String("Stored RF events: ") + String(rfEvents.size()));
+    }
 
     // WiFi.mode(WIFI_STA);
     // if (!wm.autoConnect("DMA_Device")) {  // Try to connect, else start AP
@@ -336,83 +697,78 @@ void setup() {
     
     // reconnectWiFi();
     client.setServer(mqtt_server, 1883);
+    client.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+    client.setBufferSize(MQTT_BUFFER_SIZE);
     client.setCallback(callback);
     
+    mySwitch.setGlitchFilter(RF_MIN_PULSE_US);
+    mySwitch.setEdgeRateLimit(RF_MAX_EDGES, RF_EDGE_WINDOW_US, RF_EDGE_MASK_US);
+    mySwitch.setSenderCalibration(true);  // Learn each sensor's timing for tighter matching
+    mySwitch.setLowLatency(true);         // Time a code from its first frame; held buttons keep reporting
     mySwitch.enableReceive(RF433_RX_PIN);
+    mySwitch.enableTransmit(RF433_TX_PIN);
+    mySwitch.onTransmitComplete(rfTxComplete);
     DEBUG_PRINTLN("RF-433MHz Initialized!");
 }
 
 // ✅ Loop Function
 void loop() {
-    
-    if (WiFi.status() == WL_CONNECTED) {
-        if (!client.connected()) {  // Only reconnect MQTT if disconnected
-            digitalWrite(LED_PIN, LOW);
-            reconnectMQTT();
-        }
-        client.loop();  // Always run the loop to maintain the connection
-    } else {
-        digitalWrite(LED_PIN, LOW);
-        reconnectWiFi();
-        if (WiFi.status() == WL_CONNECTED) {  // Check again after reconnecting WiFi
-            if (!client.connected()) {  // Only reconnect MQTT if disconnected
-                reconnectMQTT();
-            }
-            client.loop();
-        }
-    }
+    scheduler.run(millis());
 
-    if (digitalRead(RESET_PIN) == LOW){
-        resetWiFi();
+    serviceLink();
+    if (linkState == LINK_ONLINE) {
+        client.loop();
     }
 
+    serviceRfTx();
+    serviceRfEvents();
+    stateLog.loop(millis());
+
     unsigned long now = millis();
-    if (mySwitch.available()) {
-      unsigned long receivedCode = mySwitch.getReceivedValue();
-      int bitLength = mySwitch.getReceivedBitlength(); // Get bit length of the received signal
-      digitalWrite(LED_PIN, LOW);
-      delay(50);
-      digitalWrite(LED_PIN, HIGH);
-      delay(50);
+    // Frames decoded while the loop was busy are queued by RCSwitch; take one per pass
+    RCSwitch::ReceivedFrame frame;
+    if (mySwitch.readFrame(frame)) {
+      unsigned long receivedCode = frame.value;
+      int bitLength = frame.bitlength; // Get bit length of the received signal
+      // **Low latency mode: the first frame is held until a repeat confirms it, so a
+      // code the repeats contradict is never published. Events wait for the batch
+      // window anyway, so holding costs no latency; the event keeps the first frame's time**
+      if (frame.flags & RCSWITCH_FRAME_CANCELLED) {
+        rfHeld = false;
+        DEBUG_PRINTLN(String("Cancelled RF Signal: ") + String(receivedCode));
+        return;
+      }
+      if (!(frame.flags & RCSWITCH_FRAME_CONFIRMED)) {
+        rfHeld = true;
+        rfHeldSince = now;
+        return;
+      }
+      const unsigned long receivedAt = (rfHeld && (frame.flags & RCSWITCH_FRAME_REPEAT)) ? rfHeldSince : now;
+      rfHeld = false;
+      ledBlink(1, 50, 50);
       // **Ignore signals that do not match the expected bit length (e.g., < 24 bits)**
       if (bitLength < 24) {  
         DEBUG_PRINTLN(String("Ignored RF Signal: ") + String(receivedCode) + " (Bits: " + String(bitLength) + ")");
-        mySwitch.resetAvailable();
-        return;;
-      }
-
-      // **Short-Term Global Debounce (Ignore if received within 100ms)**
-      if (now - lastRFGlobalReceivedTime < 100) {
-        mySwitch.resetAvailable();
         return;
       }
 
-      // **Per-Sensor Debounce (Ignore same sensor within 2 sec)**
-      if (lastRFReceivedTimeMap.find(receivedCode) == lastRFReceivedTimeMap.end() || 
-          (now - lastRFReceivedTimeMap[receivedCode] > 2000)) {  
-
-        lastRFReceivedTimeMap[receivedCode] = now;  // Update per-sensor time
-        lastRFGlobalReceivedTime = now;  // Update global debounce
-
+      // **Per-Sensor and Global Rate Limits (sensors never block each other)**
+      // A held button keeps delivering repeats; its rule (or override) decides how many get out
+      RfRatePolicy::Verdict verdict = rfRatePolicy.check(receivedCode, now);
+      if (verdict == RfRatePolicy::CODE_LIMITED) {
+        DEBUG_PRINTLN(String("Repeated RF Signal: ") + String(receivedCode));
+      } else {
         // **Debug Output**
+        // Over the global rate the event is still queued; serviceRfEvents() paces the messages
+        if (verdict == RfRatePolicy::GLOBAL_LIMITED) {
+          DEBUG_PRINTLN(String("Publish rate exceeded, queued RF Signal: ") + String(receivedCode));
+        }
         DEBUG_PRINTLN(String("Valid RF Received: ") + String(receivedCode) + " (Bits: " + String(bitLength) + ")");
-        
-        // **Send Data to MQTT**
-        char data[50];
-        snprintf(data, sizeof(data), "%s,%lu", DEVICE_ID, receivedCode);
-        client.publish(mqtt_pub_topic, data);
-        DEBUG_PRINTLN(String("Data Sent to MQTT: ") + String(data));
-        digitalWrite(LED_PIN, LOW);
-        delay(50);
-        digitalWrite(LED_PIN, HIGH);
-        delay(50);
-        digitalWrite(LED_PIN, LOW);
-        delay(50);
-        digitalWrite(LED_PIN, HIGH);
-      }
+        DEBUG_PRINTLN(String("RF Code Table: ") + String(rfRatePolicy.codes().size()) + "/" + String(rfRatePolicy.codes().capacity()) +
+                      " used, " + String(rfRatePolicy.codes().evictionCount()) + " evicted");
 
-      mySwitch.resetAvailable();
+        // **Queue for MQTT; published with the next batch**
+        rfEvents.push(receivedCode, bitLength, frame.protocol, receivedAt);
+      }
     }
-
-    delay(10);
 }
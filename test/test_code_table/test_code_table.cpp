@@ -0,0 +1,174 @@
+#include <unity.h>
+#include <map>
+#include "CodeTable.h"
+
+typedef CodeTable<unsigned long, 16> Table;   // holds 12
+
+static uint32_t rng = 1;
+static uint32_t nextRandom() {
+    rng = rng * 1103515245u + 12345u;
+    return rng >> 8;
+}
+
+void setUp() {
+    rng = 1;
+}
+
+void tearDown() {
+}
+
+void test_store_and_find() {
+    Table table(1000);
+    TEST_ASSERT_NULL(table.find(42, 0));
+    table.store(42, 0) = 7;
+    TEST_ASSERT_NOT_NULL(table.find(42, 10));
+    TEST_ASSERT_EQUAL(7, *table.find(42, 10));
+    TEST_ASSERT_EQUAL(1, table.size());
+    TEST_ASSERT_NULL(table.find(43, 10));
+}
+
+void test_entries_expire_after_ttl() {
+    Table table(1000);
+    table.store(42, 0) = 7;
+    TEST_ASSERT_NOT_NULL(table.find(42, 999));
+    TEST_ASSERT_NULL(table.find(42, 1000));
+    TEST_ASSERT_EQUAL(0, table.size());
+    TEST_ASSERT_EQUAL(1, table.expiryCount());
+}
+
+void test_store_restarts_lifetime() {
+    Table table(1000);
+    table.store(42, 0) = 7;
+    TEST_ASSERT_EQUAL(7, table.store(42, 900));
+    TEST_ASSERT_NOT_NULL(table.find(42, 1800));
+    // an expired entry comes back value-initialized
+    TEST_ASSERT_EQUAL(0, table.store(42, 2900));
+}
+
+void test_erase_keeps_probe_runs_intact() {
+    Table table(1000);
+    for (unsigned long key = 1; key <= 12; key++) {
+        table.store(key * 16, 0) = key;
+    }
+    for (unsigned long key = 1; key <= 12; key += 2) {
+        TEST_ASSERT_TRUE(table.erase(key * 16));
+    }
+    TEST_ASSERT_FALSE(table.erase(16));
+    for (unsigned long key = 1; key <= 12; key++) {
+        unsigned long* value = table.find(key * 16, 1);
+        if (key % 2) {
+            TEST_ASSERT_NULL(value);
+        } else {
+            TEST_ASSERT_NOT_NULL(value);
+            TEST_ASSERT_EQUAL(key, *value);
+        }
+    }
+}
+
+void test_full_table_reclaims_expired_entry_first() {
+    Table table(1000);
+    table.store(100, 0);
+    for (unsigned long key = 1; key < table.capacity(); key++) {
+        table.store(key, 500);
+    }
+    TEST_ASSERT_EQUAL(table.capacity(), table.size());
+    table.store(200, 1200);
+    TEST_ASSERT_EQUAL(table.capacity(), table.size());
+    TEST_ASSERT_EQUAL(1, table.expiryCount());
+    TEST_ASSERT_EQUAL(0, table.evictionCount());
+    TEST_ASSERT_NULL(table.find(100, 1200));
+    TEST_ASSERT_NOT_NULL(table.find(200, 1200));
+}
+
+void test_full_table_evicts_entry_not_looked_up() {
+    Table table(100000);
+    for (unsigned long key = 1; key <= table.capacity(); key++) {
+        table.store(key, 0);
+    }
+    // every entry is fresh, so the hand clears them all before it evicts
+    table.store(1000, 1);
+    TEST_ASSERT_EQUAL(1, table.evictionCount());
+    TEST_ASSERT_EQUAL(table.capacity(), table.size());
+
+    // look up every survivor but keys 2 and 3 (at most one of which is
+    // gone already); only an entry left alone may go next
+    bool looked[13] = { false };
+    for (unsigned long key = 1; key <= 12; key++) {
+        if (key != 2 && key != 3) {
+            looked[key] = table.find(key, 2) != 0;
+        }
+    }
+    table.store(2000, 3);
+    TEST_ASSERT_EQUAL(2, table.evictionCount());
+    TEST_ASSERT_FALSE(table.find(2, 3) && table.find(3, 3));
+    for (unsigned long key = 1; key <= 12; key++) {
+        if (looked[key]) {
+            TEST_ASSERT_NOT_NULL(table.find(key, 3));
+        }
+    }
+    TEST_ASSERT_NOT_NULL(table.find(1000, 3));
+    TEST_ASSERT_NOT_NULL(table.find(2000, 3));
+    TEST_ASSERT_EQUAL(table.capacity(), table.size());
+}
+
+// Random store/find/erase traffic against std::map: the table never
+// returns a code that is absent or expired, and forgets nothing while the
+// live codes fit in it
+void test_matches_map_reference() {
+    const unsigned long ttl = 500;
+    Table table(ttl);
+    std::map<unsigned long, std::pair<unsigned long, unsigned long> > reference;  // value, stamp
+    unsigned long now = 0;
+    for (int step = 0; step < 200000; step++) {
+        now += nextRandom() % 8;
+        const unsigned long key = nextRandom() % 24;
+        std::map<unsigned long, std::pair<unsigned long, unsigned long> >::iterator it = reference.find(key);
+        const bool live = it != reference.end() && now - it->second.second < ttl;
+        switch (nextRandom() % 3) {
+            case 0: {
+                unsigned long* value = table.find(key, now);
+                if (!live) {
+                    TEST_ASSERT_NULL(value);
+                } else if (value) {
+                    TEST_ASSERT_EQUAL(it->second.first, *value);
+                }
+                break;
+            }
+            case 1: {
+                const unsigned long value = nextRandom();
+                table.store(key, now) = value;
+                reference[key] = std::make_pair(value, now);
+                break;
+            }
+            default:
+                table.erase(key);
+                reference.erase(key);
+                break;
+        }
+    }
+    TEST_ASSERT_TRUE(table.size() <= table.capacity());
+
+    // at most capacity live codes: nothing may be evicted
+    CodeTable<unsigned long, 16> roomy(100000);
+    for (int step = 0; step < 50000; step++) {
+        const unsigned long key = nextRandom() % roomy.capacity();
+        roomy.store(key, step) = key + 1;
+        TEST_ASSERT_EQUAL(key + 1, *roomy.find(key, step));
+    }
+    TEST_ASSERT_EQUAL(0, roomy.evictionCount());
+    for (unsigned long key = 0; key < roomy.capacity(); key++) {
+        TEST_ASSERT_NOT_NULL(roomy.find(key, 50000));
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_store_and_find);
+    RUN_TEST(test_entries_expire_after_ttl);
+    RUN_TEST(test_store_restarts_lifetime);
+    RUN_TEST(test_erase_keeps_probe_runs_intact);
+    RUN_TEST(test_full_table_reclaims_expired_entry_first);
+    RUN_TEST(test_full_table_evicts_entry_not_looked_up);
+    RUN_TEST(test_matches_map_reference);
+    return UNITY_END();
+}
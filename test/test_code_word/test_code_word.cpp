@@ -0,0 +1,212 @@
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include <RCSwitch.h>
+
+// The string encoders codeWordA()..codeWordD() replaced, as they were in
+// the baseline (getCodeWordA()..getCodeWordD()), and the conversion that
+// sendTriState() applied to their result.
+
+static const char* baselineA(const char* sGroup, const char* sDevice, bool bStatus) {
+    static char sReturn[13];
+    int nReturnPos = 0;
+    for (int i = 0; i < 5; i++) {
+        sReturn[nReturnPos++] = (sGroup[i] == '0') ? 'F' : '0';
+    }
+    for (int i = 0; i < 5; i++) {
+        sReturn[nReturnPos++] = (sDevice[i] == '0') ? 'F' : '0';
+    }
+    sReturn[nReturnPos++] = bStatus ? '0' : 'F';
+    sReturn[nReturnPos++] = bStatus ? 'F' : '0';
+    sReturn[nReturnPos] = '\0';
+    return sReturn;
+}
+
+static const char* baselineB(int nAddressCode, int nChannelCode, bool bStatus) {
+    static char sReturn[13];
+    int nReturnPos = 0;
+    if (nAddressCode < 1 || nAddressCode > 4 || nChannelCode < 1 || nChannelCode > 4) {
+        return 0;
+    }
+    for (int i = 1; i <= 4; i++) {
+        sReturn[nReturnPos++] = (nAddressCode == i) ? '0' : 'F';
+    }
+    for (int i = 1; i <= 4; i++) {
+        sReturn[nReturnPos++] = (nChannelCode == i) ? '0' : 'F';
+    }
+    sReturn[nReturnPos++] = 'F';
+    sReturn[nReturnPos++] = 'F';
+    sReturn[nReturnPos++] = 'F';
+    sReturn[nReturnPos++] = bStatus ? 'F' : '0';
+    sReturn[nReturnPos] = '\0';
+    return sReturn;
+}
+
+static const char* baselineC(char sFamily, int nGroup, int nDevice, bool bStatus) {
+    static char sReturn[13];
+    int nReturnPos = 0;
+    int nFamily = (int)sFamily - 'a';
+    if (nFamily < 0 || nFamily > 15 || nGroup < 1 || nGroup > 4 || nDevice < 1 || nDevice > 4) {
+        return 0;
+    }
+    sReturn[nReturnPos++] = (nFamily & 1) ? 'F' : '0';
+    sReturn[nReturnPos++] = (nFamily & 2) ? 'F' : '0';
+    sReturn[nReturnPos++] = (nFamily & 4) ? 'F' : '0';
+    sReturn[nReturnPos++] = (nFamily & 8) ? 'F' : '0';
+    sReturn[nReturnPos++] = ((nDevice-1) & 1) ? 'F' : '0';
+    sReturn[nReturnPos++] = ((nDevice-1) & 2) ? 'F' : '0';
+    sReturn[nReturnPos++] = ((nGroup-1) & 1) ? 'F' : '0';
+    sReturn[nReturnPos++] = ((nGroup-1) & 2) ? 'F' : '0';
+    sReturn[nReturnPos++] = '0';
+    sReturn[nReturnPos++] = 'F';
+    sReturn[nReturnPos++] = 'F';
+    sReturn[nReturnPos++] = bStatus ? 'F' : '0';
+    sReturn[nReturnPos] = '\0';
+    return sReturn;
+}
+
+static const char* baselineD(char sGroup, int nDevice, bool bStatus) {
+    static char sReturn[13];
+    int nReturnPos = 0;
+    int nGroup = (sGroup >= 'a') ? (int)sGroup - 'a' : (int)sGroup - 'A';
+    if (nGroup < 0 || nGroup > 3 || nDevice < 1 || nDevice > 3) {
+        return 0;
+    }
+    for (int i = 0; i < 4; i++) {
+        sReturn[nReturnPos++] = (nGroup == i) ? '1' : 'F';
+    }
+    for (int i = 1; i <= 3; i++) {
+        sReturn[nReturnPos++] = (nDevice == i) ? '1' : 'F';
+    }
+    sReturn[nReturnPos++] = '0';
+    sReturn[nReturnPos++] = '0';
+    sReturn[nReturnPos++] = '0';
+    sReturn[nReturnPos++] = bStatus ? '1' : '0';
+    sReturn[nReturnPos++] = bStatus ? '0' : '1';
+    sReturn[nReturnPos] = '\0';
+    return sReturn;
+}
+
+// sendTriState()'s bit pattern for a string, or the invalid code word
+static RCSwitch::CodeWord triState(const char* sCodeWord) {
+    RCSwitch::CodeWord word = { 0, 0 };
+    if (!sCodeWord) {
+        return word;
+    }
+    for (const char* p = sCodeWord; *p; p++) {
+        word.code <<= 2;
+        word.code |= (*p == 'F') ? 1 : (*p == '1') ? 3 : 0;
+        word.length += 2;
+    }
+    return word;
+}
+
+static void assertSame(const RCSwitch::CodeWord& expected, const RCSwitch::CodeWord& actual, const char* what) {
+    TEST_ASSERT_EQUAL_MESSAGE(expected.length, actual.length, what);
+    TEST_ASSERT_EQUAL_UINT64_MESSAGE(expected.code, actual.code, what);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_type_a_every_dip_setting() {
+    char group[6] = { 0 };
+    char device[6] = { 0 };
+    for (int g = 0; g < 32; g++) {
+        for (int d = 0; d < 32; d++) {
+            for (int i = 0; i < 5; i++) {
+                group[i] = (g >> i) & 1 ? '1' : '0';
+                device[i] = (d >> i) & 1 ? '1' : '0';
+            }
+            for (int status = 0; status < 2; status++) {
+                assertSame(triState(baselineA(group, device, status)),
+                           RCSwitch::codeWordA(group, device, status), group);
+            }
+        }
+    }
+}
+
+void test_type_b_including_out_of_range() {
+    for (int address = -1; address <= 6; address++) {
+        for (int channel = -1; channel <= 6; channel++) {
+            for (int status = 0; status < 2; status++) {
+                assertSame(triState(baselineB(address, channel, status)),
+                           RCSwitch::codeWordB(address, channel, status), "type B");
+            }
+        }
+    }
+}
+
+void test_type_c_including_out_of_range() {
+    for (char family = 'a' - 2; family <= 'p' + 2; family++) {
+        for (int group = -1; group <= 6; group++) {
+            for (int device = -1; device <= 6; device++) {
+                for (int status = 0; status < 2; status++) {
+                    assertSame(triState(baselineC(family, group, device, status)),
+                               RCSwitch::codeWordC(family, group, device, status), "type C");
+                }
+            }
+        }
+    }
+}
+
+void test_type_d_including_out_of_range() {
+    static const char groups[] = "@aAbBcCdDeE`";
+    for (const char* group = groups; *group; group++) {
+        for (int device = -1; device <= 5; device++) {
+            for (int status = 0; status < 2; status++) {
+                assertSame(triState(baselineD(*group, device, status)),
+                           RCSwitch::codeWordD(*group, device, status), "type D");
+            }
+        }
+    }
+}
+
+void test_code_words_fold_at_compile_time() {
+    static constexpr RCSwitch::CodeWord lampOn = RCSwitch::codeWordB(2, 3, true);
+    static_assert(lampOn.length == 24, "constexpr code word");
+    assertSame(triState(baselineB(2, 3, true)), lampOn, "constexpr");
+}
+
+static std::vector<unsigned long> pulses;
+static unsigned long lastEdge = 0;
+
+static void recordWrite(int, int, unsigned long time) {
+    pulses.push_back(time - lastEdge);
+    lastEdge = time;
+}
+
+// On the air, switchOn() sends what sendTriState() sent for the old string
+void test_switch_on_sends_the_baseline_pulses() {
+    RCSwitch tx = RCSwitch();
+    tx.enableTransmit(1);
+    tx.setRepeatTransmit(2);
+    rcswitchHostOnWrite(recordWrite);
+
+    pulses.clear();
+    lastEdge = micros();
+    tx.sendTriState(baselineC('b', 3, 2, true));
+    const std::vector<unsigned long> expected = pulses;
+
+    pulses.clear();
+    lastEdge = micros();
+    tx.switchOn('b', 3, 2);
+    rcswitchHostOnWrite(0);
+
+    TEST_ASSERT_GREATER_THAN(0, expected.size());
+    TEST_ASSERT_TRUE(expected == pulses);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_type_a_every_dip_setting);
+    RUN_TEST(test_type_b_including_out_of_range);
+    RUN_TEST(test_type_c_including_out_of_range);
+    RUN_TEST(test_type_d_including_out_of_range);
+    RUN_TEST(test_code_words_fold_at_compile_time);
+    RUN_TEST(test_switch_on_sends_the_baseline_pulses);
+    return UNITY_END();
+}
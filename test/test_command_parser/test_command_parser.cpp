@@ -0,0 +1,106 @@
+#include <unity.h>
+#include <string.h>
+#include "CommandParser.h"
+
+static bool parse(const char* text, Command& command) {
+    return parseCommand((const uint8_t*)text, strlen(text), command);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// Every command the firmware understood before the parser, by exact string
+void test_legacy_switch_commands() {
+    static const struct {
+        const char* text;
+        uint8_t mask;
+        uint8_t value;
+    } legacy[] = {
+        { "sw1:0", 0x1, 0 }, { "sw1:1", 0x1, 1 },
+        { "sw2:0", 0x2, 0 }, { "sw2:1", 0x2, 1 },
+        { "sw3:0", 0x4, 0 }, { "sw3:1", 0x4, 1 },
+        { "sw4:0", 0x8, 0 }, { "sw4:1", 0x8, 1 },
+        { "sw1234:0", 0xF, 0 }, { "sw1234:1", 0xF, 1 },
+    };
+    for (unsigned int i = 0; i < sizeof(legacy) / sizeof(legacy[0]); i++) {
+        Command command;
+        TEST_ASSERT_TRUE_MESSAGE(parse(legacy[i].text, command), legacy[i].text);
+        TEST_ASSERT_EQUAL_MESSAGE(Command::SWITCH, command.type, legacy[i].text);
+        TEST_ASSERT_EQUAL_MESSAGE(legacy[i].mask, command.mask, legacy[i].text);
+        TEST_ASSERT_EQUAL_MESSAGE(legacy[i].value, command.value, legacy[i].text);
+    }
+}
+
+void test_legacy_ping() {
+    Command command;
+    TEST_ASSERT_TRUE(parse("ping", command));
+    TEST_ASSERT_EQUAL(Command::PING, command.type);
+}
+
+// "rate:<code>:<burst>:<ms>", as read by sscanf() before the parser
+void test_legacy_rate() {
+    Command command;
+    TEST_ASSERT_TRUE(parse("rate:5592405:3:250", command));
+    TEST_ASSERT_EQUAL(Command::RATE, command.type);
+    TEST_ASSERT_EQUAL(5592405, command.args[0]);
+    TEST_ASSERT_EQUAL(3, command.args[1]);
+    TEST_ASSERT_EQUAL(250, command.args[2]);
+    TEST_ASSERT_TRUE(parse("rate:1:0:0", command));
+    TEST_ASSERT_EQUAL(0, command.args[1]);
+}
+
+void test_switch_subsets() {
+    Command command;
+    TEST_ASSERT_TRUE(parse("sw13:1", command));
+    TEST_ASSERT_EQUAL(0x5, command.mask);
+    TEST_ASSERT_TRUE(parse("sw24:0", command));
+    TEST_ASSERT_EQUAL(0xA, command.mask);
+    TEST_ASSERT_EQUAL(0, command.value);
+    TEST_ASSERT_TRUE(parse("sw8:1", command));
+    TEST_ASSERT_EQUAL(0x80, command.mask);
+}
+
+void test_trailing_whitespace_is_ignored() {
+    Command command;
+    TEST_ASSERT_TRUE(parse("ping\r\n", command));
+    TEST_ASSERT_EQUAL(Command::PING, command.type);
+    TEST_ASSERT_TRUE(parse("sw1:1 \t", command));
+    TEST_ASSERT_EQUAL(0x1, command.mask);
+}
+
+// The payload is a byte span: whatever follows it must not be read
+void test_payload_need_not_be_terminated() {
+    const char bytes[] = "sw1:1junk";
+    Command command;
+    TEST_ASSERT_TRUE(parseCommand((const uint8_t*)bytes, 5, command));
+    TEST_ASSERT_EQUAL(0x1, command.mask);
+    TEST_ASSERT_EQUAL(1, command.value);
+}
+
+void test_rejected_commands() {
+    static const char* const bad[] = {
+        "", "sw", "sw1", "sw1:", "sw1:2", "sw:1", "sw9:1", "sw0:1", "sw1:01",
+        "SW1:0", "pin", "pings", "ping x", "png", "rate", "rate:1:2",
+        "rate:1:2:3:4", "rate:a:1:1", "rate:99999999999999999999999:1:1",
+        " ping", "sw1:1x",
+    };
+    for (unsigned int i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        Command command;
+        TEST_ASSERT_FALSE_MESSAGE(parse(bad[i], command), bad[i]);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_legacy_switch_commands);
+    RUN_TEST(test_legacy_ping);
+    RUN_TEST(test_legacy_rate);
+    RUN_TEST(test_switch_subsets);
+    RUN_TEST(test_trailing_whitespace_is_ignored);
+    RUN_TEST(test_payload_need_not_be_terminated);
+    RUN_TEST(test_rejected_commands);
+    return UNITY_END();
+}
@@ -0,0 +1,99 @@
+#include <unity.h>
+#include "RfRatePolicy.h"
+
+// The firmware's rules: RF_CODE_BURST/_INTERVAL_MS and RF_PUBLISH_BURST/_INTERVAL_MS
+static const RfRateRule perCode = { 1, 2000 };
+static const RfRateRule global = { 8, 250 };
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_code_gets_one_event_per_interval() {
+    RfRatePolicy policy(perCode, global);
+    TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(0x111, 0));
+    TEST_ASSERT_EQUAL(RfRatePolicy::CODE_LIMITED, policy.check(0x111, 100));
+    TEST_ASSERT_EQUAL(RfRatePolicy::CODE_LIMITED, policy.check(0x111, 1999));
+    TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(0x111, 2000));
+    TEST_ASSERT_EQUAL(2, policy.codeLimitedCount());
+}
+
+void test_sensors_do_not_suppress_each_other() {
+    RfRatePolicy policy(perCode, global);
+    TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(0x111, 0));
+    TEST_ASSERT_EQUAL(RfRatePolicy::CODE_LIMITED, policy.check(0x111, 50));
+    TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(0x222, 60));
+}
+
+void test_override_lets_a_held_button_repeat() {
+    RfRatePolicy policy(perCode, global);
+    TEST_ASSERT_TRUE(policy.setOverride(0x333, { 1, 500 }));
+    TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(0x333, 0));
+    TEST_ASSERT_EQUAL(RfRatePolicy::CODE_LIMITED, policy.check(0x333, 400));
+    TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(0x333, 500));
+
+    // removed again: back to the common rule
+    TEST_ASSERT_TRUE(policy.setOverride(0x333, { 0, 0 }));
+    TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(0x333, 1000));
+    TEST_ASSERT_EQUAL(RfRatePolicy::CODE_LIMITED, policy.check(0x333, 1500));
+}
+
+void test_override_must_refill_within_the_idle_time() {
+    RfRatePolicy policy(perCode, global);
+    TEST_ASSERT_FALSE(policy.setOverride(0x333, { 10, 2000 }));
+    for (unsigned long code = 1; code <= RF_RATE_MAX_OVERRIDES; code++) {
+        TEST_ASSERT_TRUE(policy.setOverride(code, { 1, 500 }));
+    }
+    TEST_ASSERT_FALSE(policy.setOverride(0x333, { 1, 500 }));
+}
+
+// 100 distinct codes within a second: the global bucket lets 8 through at
+// once and one per 250 ms; the rest are over its budget but none is lost,
+// they are queued for paced delivery
+void test_flood_of_distinct_codes_is_queued_not_dropped() {
+    RfRatePolicy policy(perCode, global);
+    unsigned int allowed = 0;
+    unsigned int queued = 0;
+    for (unsigned long i = 0; i < 100; i++) {
+        switch (policy.check(0x10000 + i, i * 10)) {
+            case RfRatePolicy::ALLOW:
+                allowed++;
+                break;
+            case RfRatePolicy::GLOBAL_LIMITED:
+                queued++;
+                break;
+            case RfRatePolicy::CODE_LIMITED:
+                TEST_FAIL_MESSAGE("distinct code limited");
+                break;
+        }
+    }
+    TEST_ASSERT_EQUAL(11, allowed);
+    TEST_ASSERT_EQUAL(89, queued);
+    TEST_ASSERT_EQUAL(89, policy.globalLimitedCount());
+    TEST_ASSERT_EQUAL(0, policy.codeLimitedCount());
+}
+
+// A queued event used its code's token, so the repeats of that code are not
+// queued as well
+void test_queued_code_limits_its_repeats() {
+    RfRatePolicy policy(perCode, global);
+    for (unsigned long code = 1; code <= global.burst; code++) {
+        TEST_ASSERT_EQUAL(RfRatePolicy::ALLOW, policy.check(code, 0));
+    }
+    TEST_ASSERT_EQUAL(RfRatePolicy::GLOBAL_LIMITED, policy.check(0x444, 0));
+    TEST_ASSERT_EQUAL(RfRatePolicy::CODE_LIMITED, policy.check(0x444, 100));
+    TEST_ASSERT_EQUAL(RfRatePolicy::CODE_LIMITED, policy.check(0x444, 300));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_code_gets_one_event_per_interval);
+    RUN_TEST(test_sensors_do_not_suppress_each_other);
+    RUN_TEST(test_override_lets_a_held_button_repeat);
+    RUN_TEST(test_override_must_refill_within_the_idle_time);
+    RUN_TEST(test_flood_of_distinct_codes_is_queued_not_dropped);
+    RUN_TEST(test_queued_code_limits_its_repeats);
+    return UNITY_END();
+}
@@ -0,0 +1,108 @@
+#include <unity.h>
+#include <vector>
+#include <RCSwitch.h>
+
+#define RX_INTERRUPT 0
+#define SENDER_PIN 1
+#define RX_TX_PIN 2
+#define SILENCE 100000
+
+static std::vector<unsigned int> pulses;
+static int lastLevel;
+static unsigned long lastChange;
+
+static void recordWrite(int pin, int level, unsigned long time) {
+    if (pin != SENDER_PIN || level == lastLevel) {
+        return;
+    }
+    pulses.push_back(time - lastChange);
+    lastLevel = level;
+    lastChange = time;
+}
+
+// Another device transmits code; the pulses reach the receiver's interrupt
+static void receive(RCSwitch::Code code) {
+    RCSwitch sender;
+    sender.enableTransmit(SENDER_PIN);
+    sender.setRepeatTransmit(4);
+    pulses.clear();
+    lastLevel = LOW;
+    lastChange = micros();
+    rcswitchHostOnWrite(recordWrite);
+    sender.send(code, 24);
+    rcswitchHostOnWrite(0);
+    pulses.push_back(micros() - lastChange);
+    for (unsigned int i = 0; i < pulses.size(); i++) {
+        rcswitchHostEdge(RX_INTERRUPT, pulses[i]);
+    }
+    rcswitchHostEdge(RX_INTERRUPT, SILENCE);
+}
+
+// Values left in the queue, oldest first
+static std::vector<RCSwitch::Code> readAll(RCSwitch& rx) {
+    std::vector<RCSwitch::Code> values;
+    RCSwitch::ReceivedFrame frame;
+    while (rx.readFrame(frame)) {
+        values.push_back(frame.value);
+    }
+    return values;
+}
+
+void setUp() {
+    rcswitchHostAdvance(SILENCE);
+}
+
+void tearDown() {
+}
+
+void test_received_frames_are_queued() {
+    RCSwitch rx;
+    rx.enableReceive(RX_INTERRUPT);
+    receive(0x5A5A5A);
+    const std::vector<RCSwitch::Code> values = readAll(rx);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, values.size());
+    for (unsigned int i = 0; i < values.size(); i++) {
+        TEST_ASSERT_EQUAL_HEX32(0x5A5A5A, (uint32_t)values[i]);
+    }
+    rx.disableReceive();
+}
+
+// send() turns the receiver off and on again around the transmission;
+// frames that were waiting to be read are still there afterwards
+void test_sync_send_keeps_unread_frames() {
+    RCSwitch rx;
+    rx.enableReceive(RX_INTERRUPT);
+    rx.enableTransmit(RX_TX_PIN);
+    receive(0x123456);
+    const unsigned int waiting = rx.getPendingFrames();
+    TEST_ASSERT_GREATER_OR_EQUAL(1, waiting);
+
+    rx.send(0x0F0F0F, 24);
+    TEST_ASSERT_EQUAL(waiting, rx.getPendingFrames());
+    receive(0x654321);
+    const std::vector<RCSwitch::Code> values = readAll(rx);
+    TEST_ASSERT_GREATER_THAN(waiting, values.size());
+    TEST_ASSERT_EQUAL_HEX32(0x123456, (uint32_t)values.front());
+    TEST_ASSERT_EQUAL_HEX32(0x654321, (uint32_t)values.back());
+    rx.disableReceive();
+}
+
+void test_reenabling_keeps_unread_frames() {
+    RCSwitch rx;
+    rx.enableReceive(RX_INTERRUPT);
+    receive(0x123456);
+    const unsigned int waiting = rx.getPendingFrames();
+    rx.disableReceive();
+    rx.enableReceive(RX_INTERRUPT);
+    TEST_ASSERT_EQUAL(waiting, rx.getPendingFrames());
+    TEST_ASSERT_EQUAL_HEX32(0x123456, (uint32_t)readAll(rx).front());
+    rx.disableReceive();
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_received_frames_are_queued);
+    RUN_TEST(test_sync_send_keeps_unread_frames);
+    RUN_TEST(test_reenabling_keeps_unread_frames);
+    return UNITY_END();
+}
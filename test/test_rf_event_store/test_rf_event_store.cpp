@@ -0,0 +1,242 @@
+#include <unity.h>
+#include <vector>
+#include "RfEventStore.h"
+
+#define FIRST_SECTOR 4
+#define RECORD_SIZE 16
+
+static FlashArea ring(uint16_t sectors) {
+    return flashArea(FIRST_SECTOR, sectors);
+}
+
+static void pushCodes(RfEventStore& store, uint32_t first, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        store.push(first + i, 24, 1, 1000 + first + i);
+    }
+}
+
+// Everything left in the store, popped one at a time
+static std::vector<RfEvent> drain(RfEventStore& store) {
+    std::vector<RfEvent> events;
+    RfEvent event;
+    while (store.peek(event)) {
+        events.push_back(event);
+        store.pop();
+    }
+    return events;
+}
+
+// Overwrites one byte of the record in slot of sector, as a write cut short
+// by a reset would leave it
+static void tear(uint16_t sector, uint16_t slot) {
+    uint8_t* record = flashAreaHostData() + (FIRST_SECTOR + sector) * FLASH_AREA_SECTOR_SIZE + slot * RECORD_SIZE;
+    record[8] ^= 0x5A;
+}
+
+void setUp() {
+    flashAreaHostErase();
+}
+
+void tearDown() {
+}
+
+void test_events_spill_from_ram_to_flash_in_order() {
+    RfEventStore store;
+    TEST_ASSERT_TRUE(store.begin(ring(3)));
+    pushCodes(store, 100, RF_EVENT_RAM_SIZE + 8);
+    TEST_ASSERT_EQUAL(8, store.spilledCount());
+    TEST_ASSERT_EQUAL(RF_EVENT_RAM_SIZE + 8, store.size());
+
+    RfEvent batch[RF_EVENT_RAM_SIZE + 8];
+    TEST_ASSERT_EQUAL(RF_EVENT_RAM_SIZE + 8, store.peek(batch, RF_EVENT_RAM_SIZE + 8));
+    for (unsigned int i = 0; i < RF_EVENT_RAM_SIZE + 8; i++) {
+        TEST_ASSERT_EQUAL(100 + i, batch[i].code);
+        TEST_ASSERT_EQUAL(1 + i, batch[i].seq);
+    }
+    const std::vector<RfEvent> events = drain(store);
+    TEST_ASSERT_EQUAL(RF_EVENT_RAM_SIZE + 8, events.size());
+    for (unsigned int i = 0; i < events.size(); i++) {
+        TEST_ASSERT_EQUAL(100 + i, events[i].code);
+    }
+    TEST_ASSERT_TRUE(store.empty());
+}
+
+void test_persisted_events_survive_a_restart() {
+    {
+        RfEventStore store;
+        store.begin(ring(3));
+        pushCodes(store, 100, 20);
+        store.persist();
+    }
+    RfEventStore store;
+    store.begin(ring(3));
+    TEST_ASSERT_EQUAL(20, store.size());
+    const std::vector<RfEvent> events = drain(store);
+    TEST_ASSERT_EQUAL(20, events.size());
+    for (unsigned int i = 0; i < events.size(); i++) {
+        TEST_ASSERT_EQUAL(100 + i, events[i].code);
+        TEST_ASSERT_FALSE(store.fromThisBoot(events[i]));
+    }
+}
+
+// Slot 0 holds the first mark, so event n (from 1) is in slot n; slot 5
+// holds code 104
+void test_torn_record_is_skipped_by_peek_and_pop() {
+    RfEventStore store;
+    store.begin(ring(3));
+    pushCodes(store, 100, 10);
+    store.persist();
+    tear(0, 5);
+
+    RfEvent batch[10];
+    TEST_ASSERT_EQUAL(9, store.peek(batch, 10));
+    const std::vector<RfEvent> events = drain(store);
+    TEST_ASSERT_EQUAL(9, events.size());
+    for (unsigned int i = 0; i < events.size(); i++) {
+        TEST_ASSERT_EQUAL(batch[i].seq, events[i].seq);
+        TEST_ASSERT_TRUE(events[i].code != 104);
+    }
+    TEST_ASSERT_TRUE(store.empty());
+}
+
+void test_torn_record_is_skipped_after_a_restart() {
+    {
+        RfEventStore store;
+        store.begin(ring(3));
+        pushCodes(store, 100, 10);
+        store.persist();
+    }
+    tear(0, 5);
+    RfEventStore store;
+    store.begin(ring(3));
+    TEST_ASSERT_EQUAL(9, store.size());
+    const std::vector<RfEvent> events = drain(store);
+    TEST_ASSERT_EQUAL(9, events.size());
+    TEST_ASSERT_EQUAL(103, events[3].code);
+    TEST_ASSERT_EQUAL(105, events[4].code);
+}
+
+// A drained ring is erased down to one sector holding a mark, so the
+// numbers handed out so far are still covered after a restart
+void test_drain_leaves_a_mark() {
+    uint32_t last;
+    {
+        RfEventStore store;
+        store.begin(ring(3));
+        pushCodes(store, 100, 600);
+        store.persist();
+        const std::vector<RfEvent> events = drain(store);
+        TEST_ASSERT_EQUAL(600, events.size());
+        last = events.back().seq;
+        TEST_ASSERT_TRUE(store.empty());
+    }
+    for (uint16_t s = 0; s < 3; s++) {
+        TEST_ASSERT_GREATER_OR_EQUAL(1, flashAreaHostEraseCount(FIRST_SECTOR + s));
+    }
+    RfEventStore store;
+    store.begin(ring(3));
+    TEST_ASSERT_TRUE(store.empty());
+    store.push(1, 24, 1, 0);
+    RfEvent event;
+    TEST_ASSERT_TRUE(store.peek(event));
+    TEST_ASSERT_TRUE((int32_t)(event.seq - last) > 0);
+    TEST_ASSERT_TRUE(store.fromThisBoot(event));
+}
+
+// Events delivered from RAM never reach flash; only the marks remember them
+void test_sequence_numbers_rise_across_restarts() {
+    uint32_t last = 0;
+    for (int boot = 0; boot < 5; boot++) {
+        RfEventStore store;
+        store.begin(ring(3));
+        pushCodes(store, 100, 3);
+        const std::vector<RfEvent> events = drain(store);
+        TEST_ASSERT_EQUAL(3, events.size());
+        for (unsigned int i = 0; i < events.size(); i++) {
+            TEST_ASSERT_TRUE((int32_t)(events[i].seq - last) > 0);
+            last = events[i].seq;
+        }
+    }
+    // and the RAM events lost to a restart are not reused either
+    {
+        RfEventStore store;
+        store.begin(ring(3));
+        pushCodes(store, 100, 10);
+        RfEvent event;
+        store.peek(event);
+        last = event.seq + 9;
+    }
+    RfEventStore store;
+    store.begin(ring(3));
+    store.push(1, 24, 1, 0);
+    RfEvent event;
+    store.peek(event);
+    TEST_ASSERT_TRUE((int32_t)(event.seq - last) > 0);
+}
+
+// Delivering while receiving keeps the ring moving round its sectors
+void test_ring_wraps_round_its_sectors() {
+    RfEventStore store;
+    store.begin(ring(3));
+    uint32_t code = 0;
+    uint32_t expected = 0;
+    for (int round = 0; round < 12; round++) {
+        pushCodes(store, code, 300);
+        code += 300;
+        store.persist();
+        for (int i = 0; i < 295; i++) {
+            RfEvent event;
+            TEST_ASSERT_TRUE(store.peek(event));
+            TEST_ASSERT_EQUAL(expected++, event.code);
+            store.pop();
+        }
+    }
+    TEST_ASSERT_EQUAL(0, store.droppedCount());
+    const std::vector<RfEvent> events = drain(store);
+    TEST_ASSERT_EQUAL(code - expected, events.size());
+    for (unsigned int i = 0; i < events.size(); i++) {
+        TEST_ASSERT_EQUAL(expected + i, events[i].code);
+    }
+    for (uint16_t s = 0; s < 3; s++) {
+        TEST_ASSERT_GREATER_OR_EQUAL(3, flashAreaHostEraseCount(FIRST_SECTOR + s));
+    }
+}
+
+// A full ring drops its oldest sector; what is left stays in order and ends
+// with the newest event
+void test_full_ring_drops_oldest_sector() {
+    RfEventStore store;
+    store.begin(ring(3));
+    pushCodes(store, 0, 2000);
+    TEST_ASSERT_GREATER_THAN(0, store.droppedCount());
+    TEST_ASSERT_EQUAL(2000, store.size() + store.droppedCount());
+    const std::vector<RfEvent> events = drain(store);
+    TEST_ASSERT_EQUAL(1999, events.back().code);
+    for (unsigned int i = 1; i < events.size(); i++) {
+        TEST_ASSERT_EQUAL(events[i - 1].code + 1, events[i].code);
+    }
+}
+
+void test_without_flash_only_ram_is_used() {
+    RfEventStore store;
+    TEST_ASSERT_FALSE(store.begin(flashArea(FIRST_SECTOR, FLASH_AREA_HOST_SECTORS)));
+    pushCodes(store, 0, RF_EVENT_RAM_SIZE + 5);
+    TEST_ASSERT_EQUAL(5, store.droppedCount());
+    const std::vector<RfEvent> events = drain(store);
+    TEST_ASSERT_EQUAL(RF_EVENT_RAM_SIZE, events.size());
+    TEST_ASSERT_EQUAL(5, events.front().code);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_events_spill_from_ram_to_flash_in_order);
+    RUN_TEST(test_persisted_events_survive_a_restart);
+    RUN_TEST(test_torn_record_is_skipped_by_peek_and_pop);
+    RUN_TEST(test_torn_record_is_skipped_after_a_restart);
+    RUN_TEST(test_drain_leaves_a_mark);
+    RUN_TEST(test_sequence_numbers_rise_across_restarts);
+    RUN_TEST(test_ring_wraps_round_its_sectors);
+    RUN_TEST(test_full_ring_drops_oldest_sector);
+    RUN_TEST(test_without_flash_only_ram_is_used);
+    return UNITY_END();
+}
@@ -0,0 +1,178 @@
+#include <unity.h>
+#include <string.h>
+#include "StateLog.h"
+
+#define SECTORS 4
+#define RECORD_SIZE 8
+#define RECORDS_PER_SECTOR (FLASH_AREA_SECTOR_SIZE / RECORD_SIZE)
+#define COMMIT_DELAY 2000
+
+static FlashArea logArea() {
+    return flashArea(0, SECTORS);
+}
+
+// State a log finds after a restart, or -1
+static long restored() {
+    StateLog log(COMMIT_DELAY);
+    uint16_t state;
+    if (!log.begin(logArea()) || !log.restore(state)) {
+        return -1;
+    }
+    return state;
+}
+
+static uint8_t* record(uint16_t sector, uint16_t slot) {
+    return flashAreaHostData() + sector * FLASH_AREA_SECTOR_SIZE + slot * RECORD_SIZE;
+}
+
+void setUp() {
+    flashAreaHostErase();
+}
+
+void tearDown() {
+}
+
+void test_empty_area_has_no_state() {
+    TEST_ASSERT_EQUAL(-1, restored());
+    StateLog log(COMMIT_DELAY);
+    TEST_ASSERT_FALSE(log.begin(flashArea(0, 0)));
+}
+
+void test_save_is_written_after_the_commit_delay() {
+    StateLog log(COMMIT_DELAY);
+    log.begin(logArea());
+    log.save(0x5, 100);
+    log.loop(100 + COMMIT_DELAY - 1);
+    TEST_ASSERT_EQUAL(0, log.commitCount());
+    TEST_ASSERT_EQUAL(-1, restored());
+    log.loop(100 + COMMIT_DELAY);
+    TEST_ASSERT_EQUAL(1, log.commitCount());
+    TEST_ASSERT_EQUAL(0x5, restored());
+}
+
+void test_burst_is_coalesced_into_one_record() {
+    StateLog log(COMMIT_DELAY);
+    log.begin(logArea());
+    for (uint16_t i = 0; i < 10; i++) {
+        log.save(i, 100 + i * 10);
+    }
+    log.loop(100 + COMMIT_DELAY);
+    TEST_ASSERT_EQUAL(1, log.commitCount());
+    TEST_ASSERT_EQUAL(9, log.coalescedCount());
+    TEST_ASSERT_EQUAL(9, restored());
+
+    // toggled back to the saved state: nothing to write
+    log.save(3, 5000);
+    log.save(9, 5001);
+    log.flush();
+    TEST_ASSERT_EQUAL(1, log.commitCount());
+}
+
+void test_flush_writes_right_away() {
+    StateLog log(COMMIT_DELAY);
+    log.begin(logArea());
+    log.save(0xA, 0);
+    log.flush();
+    TEST_ASSERT_EQUAL(0xA, restored());
+}
+
+// Many commits: the latest wins after a restart, and every sector takes
+// its share of the erases
+void test_log_wraps_and_spreads_wear() {
+    const unsigned long commits = SECTORS * RECORDS_PER_SECTOR * 5 + 123;
+    {
+        StateLog log(COMMIT_DELAY);
+        log.begin(logArea());
+        for (unsigned long i = 0; i < commits; i++) {
+            log.save(i & 0xFFFF, 0);
+            log.flush();
+        }
+        TEST_ASSERT_EQUAL(commits, log.commitCount());
+    }
+    TEST_ASSERT_EQUAL((commits - 1) & 0xFFFF, restored());
+
+    unsigned long least = ~0UL;
+    unsigned long most = 0;
+    for (uint16_t s = 0; s < SECTORS; s++) {
+        const unsigned long erases = flashAreaHostEraseCount(s);
+        if (erases < least) least = erases;
+        if (erases > most) most = erases;
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(5, least);
+    TEST_ASSERT_LESS_OR_EQUAL(least + 1, most);
+}
+
+// The log picks up where it was after a restart, across a sector boundary
+void test_restart_continues_the_log() {
+    for (uint16_t i = 1; i <= RECORDS_PER_SECTOR + 10; i++) {
+        StateLog log(COMMIT_DELAY);
+        log.begin(logArea());
+        log.save(i, 0);
+        log.flush();
+    }
+    TEST_ASSERT_EQUAL(RECORDS_PER_SECTOR + 10, restored());
+}
+
+// A record whose CRC does not match is skipped: the one before it is the
+// state, and the log goes on after it
+void test_torn_newest_record_falls_back_to_previous() {
+    StateLog log(COMMIT_DELAY);
+    log.begin(logArea());
+    for (uint16_t i = 1; i <= 3; i++) {
+        log.save(i, 0);
+        log.flush();
+    }
+    // an empty log starts writing at sector 0
+    record(0, 2)[4] ^= 0x01;
+    TEST_ASSERT_EQUAL(2, restored());
+
+    StateLog after(COMMIT_DELAY);
+    after.begin(logArea());
+    after.save(7, 0);
+    after.flush();
+    TEST_ASSERT_EQUAL(7, restored());
+}
+
+// A write cut short after the newest record is not mistaken for free space
+void test_partial_write_after_newest_record_is_skipped() {
+    {
+        StateLog log(COMMIT_DELAY);
+        log.begin(logArea());
+        log.save(1, 0);
+        log.flush();
+    }
+    memset(record(0, 1), 0x00, 4);
+    TEST_ASSERT_EQUAL(1, restored());
+
+    StateLog log(COMMIT_DELAY);
+    log.begin(logArea());
+    log.save(2, 0);
+    log.flush();
+    TEST_ASSERT_EQUAL(2, restored());
+}
+
+// Bytes that were never a log are ignored, and the log starts fresh
+void test_foreign_data_is_not_restored() {
+    memset(flashAreaHostData(), 0x00, SECTORS * FLASH_AREA_SECTOR_SIZE);
+    TEST_ASSERT_EQUAL(-1, restored());
+    StateLog log(COMMIT_DELAY);
+    log.begin(logArea());
+    log.save(4, 0);
+    log.flush();
+    TEST_ASSERT_EQUAL(1, log.commitCount());
+    TEST_ASSERT_EQUAL(4, restored());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_area_has_no_state);
+    RUN_TEST(test_save_is_written_after_the_commit_delay);
+    RUN_TEST(test_burst_is_coalesced_into_one_record);
+    RUN_TEST(test_flush_writes_right_away);
+    RUN_TEST(test_log_wraps_and_spreads_wear);
+    RUN_TEST(test_restart_continues_the_log);
+    RUN_TEST(test_torn_newest_record_falls_back_to_previous);
+    RUN_TEST(test_partial_write_after_newest_record_is_skipped);
+    RUN_TEST(test_foreign_data_is_not_restored);
+    return UNITY_END();
+}
@@ -0,0 +1,101 @@
+#include <unity.h>
+#include <vector>
+#include "SwitchBank.h"
+
+typedef SwitchBank<14, 13, 12, 4> Relays;
+typedef SwitchBank<14, 13, 12, 4, 16> RelaysWith16;
+
+struct PinWrite {
+    int pin;
+    int level;
+};
+static std::vector<PinWrite> writes;
+
+static void recordWrite(int pin, int level, unsigned long) {
+    PinWrite write = { pin, level };
+    writes.push_back(write);
+}
+
+void setUp() {
+    writes.clear();
+    rcswitchHostOnWrite(recordWrite);
+}
+
+void tearDown() {
+    rcswitchHostOnWrite(0);
+}
+
+void test_masks_cover_the_bank() {
+    TEST_ASSERT_EQUAL(4, Relays::size());
+    TEST_ASSERT_EQUAL_HEX16(0x0F, Relays::all());
+    TEST_ASSERT_EQUAL_HEX16(0x1F, RelaysWith16::all());
+}
+
+// A group change is one set and one clear mask over GPIO0..15
+void test_register_masks() {
+    uint32_t set;
+    uint32_t clear;
+    Relays::registerMasks(0x0F, 0, set, clear);
+    TEST_ASSERT_EQUAL_HEX32((1UL << 14) | (1UL << 13) | (1UL << 12) | (1UL << 4), set);
+    TEST_ASSERT_EQUAL_HEX32(0, clear);
+
+    Relays::registerMasks(0x05, 0x0A, set, clear);
+    TEST_ASSERT_EQUAL_HEX32((1UL << 14) | (1UL << 12), set);
+    TEST_ASSERT_EQUAL_HEX32((1UL << 13) | (1UL << 4), clear);
+
+    // GPIO16 is not in the registers; it is written on its own
+    RelaysWith16::registerMasks(0x10, 0x01, set, clear);
+    TEST_ASSERT_EQUAL_HEX32(0, set);
+    TEST_ASSERT_EQUAL_HEX32(1UL << 14, clear);
+}
+
+void test_apply_reports_and_writes_only_changes() {
+    Relays relays;
+    TEST_ASSERT_EQUAL_HEX16(0x05, relays.apply(0x05, true));
+    TEST_ASSERT_EQUAL(2, writes.size());
+    TEST_ASSERT_EQUAL(14, writes[0].pin);
+    TEST_ASSERT_EQUAL(HIGH, writes[0].level);
+    TEST_ASSERT_EQUAL(12, writes[1].pin);
+
+    writes.clear();
+    TEST_ASSERT_EQUAL_HEX16(0x02, relays.apply(0x07, true));
+    TEST_ASSERT_EQUAL(1, writes.size());
+    TEST_ASSERT_EQUAL(13, writes[0].pin);
+    TEST_ASSERT_EQUAL_HEX16(0x07, relays.snapshot());
+
+    writes.clear();
+    TEST_ASSERT_EQUAL_HEX16(0x01, relays.apply(0x09, false));
+    TEST_ASSERT_EQUAL(1, writes.size());
+    TEST_ASSERT_EQUAL(14, writes[0].pin);
+    TEST_ASSERT_EQUAL(LOW, writes[0].level);
+    TEST_ASSERT_FALSE(relays.get(0));
+    TEST_ASSERT_TRUE(relays.get(1));
+    TEST_ASSERT_EQUAL_HEX16(0x06, relays.snapshot());
+}
+
+void test_apply_ignores_channels_outside_the_bank() {
+    Relays relays;
+    TEST_ASSERT_EQUAL_HEX16(0x01, relays.apply(0xF1, true));
+    TEST_ASSERT_EQUAL_HEX16(0x01, relays.snapshot());
+}
+
+void test_restore_sets_every_channel() {
+    Relays relays;
+    relays.restore(0xFA);
+    TEST_ASSERT_EQUAL_HEX16(0x0A, relays.snapshot());
+    TEST_ASSERT_EQUAL(4, writes.size());
+    for (unsigned int i = 0; i < writes.size(); i++) {
+        const int expected = (writes[i].pin == 13 || writes[i].pin == 4) ? HIGH : LOW;
+        TEST_ASSERT_EQUAL(expected, writes[i].level);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_masks_cover_the_bank);
+    RUN_TEST(test_register_masks);
+    RUN_TEST(test_apply_reports_and_writes_only_changes);
+    RUN_TEST(test_apply_ignores_channels_outside_the_bank);
+    RUN_TEST(test_restore_sets_every_channel);
+    return UNITY_END();
+}
@@ -0,0 +1,238 @@
+/*
+  payload - host encoder/decoder for the switch's binary MQTT payload
+  (lib/payload/Payload.h), for backends and for checking the format.
+
+  Decoding prints each message in the CSV form the firmware publishes when
+  MQTT_BINARY_PAYLOAD is off, so the two can be compared line by line:
+
+    payload -d 0101062c6d7d3a5a0400 ...     hex, one message per argument
+
+  The round-trip test encodes random messages of every type, decodes them
+  again and compares every field; it also feeds every truncated and every
+  single-bit-flipped encoding to the decoder, which has to reject the
+  truncated ones and must never read past the end. It reports the average
+  size of each type in binary and as CSV.
+
+    payload -t [-n messages per type] [-r seed]
+
+  Exit status is 0 when every message round-trips, 1 otherwise.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Payload.h"
+
+#define MAX_PAYLOAD 512
+#define FRESH_MS 500    // a lone event younger than this is sent as "id,code"
+
+static const char* typeNames[PAYLOAD_TYPE_END] = { "?", "rf", "switch", "status", "rftx", "rate" };
+
+// The CSV line the firmware publishes for the same message
+static int toCsv(const PayloadMessage& m, char* out, size_t size) {
+  int pos = snprintf(out, size, "%016llu,", (unsigned long long)m.device);
+  switch (m.type) {
+  case PAYLOAD_RF_EVENTS:
+    if (m.eventCount == 1 && m.age != PAYLOAD_AGE_UNKNOWN && m.age < FRESH_MS) {
+      return pos + snprintf(out + pos, size - pos, "%lu", (unsigned long)m.events[0].code);
+    }
+    pos += (m.age == PAYLOAD_AGE_UNKNOWN) ?
+      snprintf(out + pos, size - pos, "rfb:%lu:", (unsigned long)m.seq) :
+      snprintf(out + pos, size - pos, "rfb:%lu:%lu", (unsigned long)m.seq, (unsigned long)m.age);
+    for (uint8_t i = 0; i < m.eventCount; i++) {
+      const PayloadRfEvent& e = m.events[i];
+      pos += snprintf(out + pos, size - pos, ",%lu:%u:%u:%lu", (unsigned long)e.code, e.bits, e.protocol,
+                      (unsigned long)e.dt);
+    }
+    return pos;
+  case PAYLOAD_SWITCH:
+    pos += snprintf(out + pos, size - pos, "sw");
+    for (uint8_t i = 0; i < 16; i++) {
+      if (m.mask & (1 << i)) {
+        pos += snprintf(out + pos, size - pos, "%u", i + 1);
+      }
+    }
+    return pos + snprintf(out + pos, size - pos, ":%u", m.value);
+  case PAYLOAD_STATUS:
+    return pos + snprintf(out + pos, size - pos, "%s,%u.%u.%u.%u,%d,%lu", m.ssid, m.ip[0], m.ip[1], m.ip[2],
+                          m.ip[3], m.rssi, (unsigned long)m.interval);
+  case PAYLOAD_RF_TX:
+    return pos + snprintf(out + pos, size - pos, "rftx:%lu%s", (unsigned long)m.code, m.status ? ":busy" : "");
+  case PAYLOAD_RATE:
+    return pos + snprintf(out + pos, size - pos, "rate:%lu:%s", (unsigned long)m.code, m.status ? "error" : "ok");
+  }
+  return 0;
+}
+
+static bool decodeHex(const char* hex) {
+  uint8_t bytes[MAX_PAYLOAD];
+  size_t length = strlen(hex) / 2;
+  if (strlen(hex) % 2 || length > sizeof(bytes)) {
+    fprintf(stderr, "bad hex '%s'\n", hex);
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    unsigned int b;
+    if (sscanf(hex + 2 * i, "%2x", &b) != 1) {
+      fprintf(stderr, "bad hex '%s'\n", hex);
+      return false;
+    }
+    bytes[i] = b;
+  }
+  PayloadMessage m;
+  if (!payloadDecode(bytes, length, m)) {
+    fprintf(stderr, "undecodable payload '%s'\n", hex);
+    return false;
+  }
+  char csv[MAX_PAYLOAD * 2];
+  toCsv(m, csv, sizeof(csv));
+  printf("%s\n", csv);
+  return true;
+}
+
+static uint32_t randomBits(unsigned int bits) {
+  uint32_t value = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+  return bits >= 32 ? value : value & ((1UL << bits) - 1);
+}
+
+// Random message of a type, with values around the magnitudes seen in use
+static void randomMessage(uint8_t type, PayloadMessage& m) {
+  memset(&m, 0, sizeof(m));
+  m.type = type;
+  m.device = 1225102502120000ULL + rand() % 10000;
+  switch (type) {
+  case PAYLOAD_RF_EVENTS:
+    m.seq = randomBits(1 + rand() % 32);
+    m.age = (rand() % 8 == 0) ? PAYLOAD_AGE_UNKNOWN : randomBits(rand() % 24);
+    m.eventCount = 1 + rand() % 12;
+    for (uint8_t i = 0; i < m.eventCount; i++) {
+      m.events[i].bits = 12 + rand() % 21;
+      m.events[i].code = randomBits(m.events[i].bits);
+      m.events[i].protocol = 1 + rand() % 12;
+      m.events[i].dt = i ? m.events[i - 1].dt + rand() % 300 : 0;
+    }
+    break;
+  case PAYLOAD_SWITCH:
+    m.mask = 1 + rand() % 15;
+    m.value = rand() % 2;
+    m.state = rand() % 16;
+    break;
+  case PAYLOAD_STATUS:
+    m.state = rand() % 16;
+    m.rssi = -30 - rand() % 70;
+    m.interval = 300000;
+    for (int i = 0; i < 4; i++) m.ip[i] = rand();
+    for (int i = 0, n = rand() % (PAYLOAD_MAX_SSID + 1); i < n; i++) m.ssid[i] = 'a' + rand() % 26;
+    break;
+  case PAYLOAD_RF_TX:
+  case PAYLOAD_RATE:
+    m.code = randomBits(24);
+    m.status = rand() % 2;
+    break;
+  }
+}
+
+static bool sameMessage(const PayloadMessage& a, const PayloadMessage& b) {
+  char ca[MAX_PAYLOAD * 2], cb[MAX_PAYLOAD * 2];
+  toCsv(a, ca, sizeof(ca));
+  toCsv(b, cb, sizeof(cb));
+  if (a.type != b.type || a.device != b.device || strcmp(ca, cb) != 0) {
+    return false;
+  }
+  switch (a.type) {
+  case PAYLOAD_RF_EVENTS:
+    if (a.seq != b.seq || a.age != b.age || a.eventCount != b.eventCount) {
+      return false;
+    }
+    for (uint8_t i = 0; i < a.eventCount; i++) {
+      const PayloadRfEvent& ea = a.events[i];
+      const PayloadRfEvent& eb = b.events[i];
+      if (ea.code != eb.code || ea.bits != eb.bits || ea.protocol != eb.protocol || ea.dt != eb.dt) {
+        return false;
+      }
+    }
+    return true;
+  case PAYLOAD_SWITCH:
+    return a.mask == b.mask && a.value == b.value && a.state == b.state;
+  case PAYLOAD_STATUS:
+    return a.state == b.state && a.rssi == b.rssi && a.interval == b.interval &&
+           memcmp(a.ip, b.ip, 4) == 0 && strcmp(a.ssid, b.ssid) == 0;
+  default:
+    return a.code == b.code && a.status == b.status;
+  }
+}
+
+static bool roundTrip(unsigned long count) {
+  unsigned long failures = 0;
+  printf("type     messages  binary B  csv B  saved\n");
+  for (uint8_t type = PAYLOAD_RF_EVENTS; type < PAYLOAD_TYPE_END; type++) {
+    unsigned long binaryBytes = 0, csvBytes = 0;
+    for (unsigned long n = 0; n < count; n++) {
+      PayloadMessage in, out;
+      randomMessage(type, in);
+      uint8_t bytes[MAX_PAYLOAD];
+      const size_t size = payloadEncode(in, bytes, sizeof(bytes));
+      char csv[MAX_PAYLOAD * 2];
+      binaryBytes += size;
+      csvBytes += toCsv(in, csv, sizeof(csv));
+      if (size == 0 || !payloadDecode(bytes, size, out) || !sameMessage(in, out)) {
+        if (failures++ < 5) fprintf(stderr, "%s message %lu does not round-trip: %s\n", typeNames[type], n, csv);
+        continue;
+      }
+      // the exact size is needed, so every proper prefix must be refused
+      for (size_t cut = 0; cut < size; cut++) {
+        std::vector<uint8_t> prefix(bytes, bytes + cut);
+        if (payloadDecode(prefix.data(), cut, out)) {
+          if (failures++ < 5) fprintf(stderr, "%s message %lu decodes from %zu of %zu bytes\n", typeNames[type], n, cut, size);
+          break;
+        }
+      }
+      // flipped bits may decode to something else, but must stay in bounds
+      for (size_t bit = 0; bit < size * 8; bit++) {
+        std::vector<uint8_t> damaged(bytes, bytes + size);
+        damaged[bit / 8] ^= 1 << (bit % 8);
+        payloadDecode(damaged.data(), size, out);
+      }
+      // so does the encoder with too little room
+      if (payloadEncode(in, bytes, size - 1) != 0) {
+        if (failures++ < 5) fprintf(stderr, "%s message %lu encodes into %zu bytes\n", typeNames[type], n, size - 1);
+      }
+    }
+    printf("%-8s %8lu  %8.1f  %5.1f  %4.0f%%\n", typeNames[type], count, (double)binaryBytes / count,
+           (double)csvBytes / count, 100.0 - 100.0 * binaryBytes / csvBytes);
+  }
+  printf("%s: %lu failures\n", failures ? "FAILED" : "ok", failures);
+  return failures == 0;
+}
+
+int main(int argc, char** argv) {
+  unsigned long count = 10000;
+  bool test = false;
+  bool ok = true;
+  int decoded = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0) {
+      test = true;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      count = strtoul(argv[++i], 0, 10);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      srand(strtoul(argv[++i], 0, 10));
+    } else if (strcmp(argv[i], "-d") == 0) {
+      for (; i + 1 < argc && argv[i + 1][0] != '-'; i++, decoded++) {
+        ok = decodeHex(argv[i + 1]) && ok;
+      }
+    } else {
+      fprintf(stderr, "usage: %s -t [-n messages per type] [-r seed] | -d hex...\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!test && decoded == 0) {
+    fprintf(stderr, "usage: %s -t [-n messages per type] [-r seed] | -d hex...\n", argv[0]);
+    return 2;
+  }
+  if (test && count > 0) {
+    ok = roundTrip(count) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,318 @@
+/*
+  rfbench - decode robustness benchmark for the RCSwitch receive path.
+
+  For every predefined protocol, transmissions of random codes are produced
+  by RCSwitch::send() on the host build, then degraded the way a noisy
+  433 MHz band does it:
+
+    - pulse jitter: every duration is scaled by a random factor
+    - glitch spikes: short pulses of the opposite level cut into a pulse
+    - dropped edges: two neighbouring pulses merge into one
+    - interleaved transmitters: a second transmission overlaps the first
+      (the receiver sees the OR of both carriers)
+
+  with random noise pulses between transmissions. The degraded traces are
+  replayed through handleInterrupt() for each receive tolerance, and the
+  result is a matrix over tolerance and noise level of
+
+    decode%  transmissions of which at least one frame decoded correctly
+    false%   decoded frames that match no transmitted code
+    ns/edge  host CPU time spent in the receive path per edge
+
+  Usage: rfbench [-n transmissions per protocol] [-r seed] [-p protocol]
+                 [-g min pulse us] [-e max edges:window us:mask us] [-c]
+
+  -g and -e enable the receiver's glitch filter and edge rate limit, -c its
+  sender calibration.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include <RCSwitch.h>
+
+#define RX_INTERRUPT 0
+#define TX_PIN 1
+
+#define NOISE_LEVELS 5
+#define CODE_BITS 24
+#define REPEATS 10
+
+static const int tolerances[] = { 20, 30, 40, 50, 60, 80 };
+
+static unsigned int minPulse = 0;
+static unsigned int maxEdges = 0;
+static unsigned long edgeWindow = 0;
+static unsigned long maskTime = 0;
+static bool calibrate = false;
+
+/** A stretch of constant level */
+struct Pulse {
+  bool high;
+  unsigned int duration;
+};
+
+/** One transmission (or two, interleaved) followed by noise */
+struct Segment {
+  std::vector<unsigned int> durations;
+  RCSwitch::Code codes[2];
+  unsigned int nCodes;
+};
+
+static unsigned long long rngState = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t rng() {
+  // xorshift64*
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+  return (uint32_t)((rngState * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/** Uniform in [0, 1) */
+static double uniform() {
+  return rng() / 4294967296.0;
+}
+
+static std::vector<Pulse>* capture = 0;
+static unsigned long lastChange = 0;
+
+static void recordWrite(int pin, int level, unsigned long time) {
+  if (pin != TX_PIN || capture->back().high == (level == HIGH)) {
+    return;
+  }
+  capture->back().duration = time - lastChange;
+  capture->push_back(Pulse { level == HIGH, 0 });
+  lastChange = time;
+}
+
+/** Clean waveform of one transmission, as the transmitter drives it */
+static std::vector<Pulse> transmission(int protocol, RCSwitch::Code code) {
+  std::vector<Pulse> wave;
+  wave.push_back(Pulse { false, 0 });
+
+  RCSwitch tx = RCSwitch();
+  tx.enableTransmit(TX_PIN);
+  tx.setProtocol(protocol);
+  tx.setRepeatTransmit(REPEATS);
+
+  capture = &wave;
+  lastChange = micros();
+  rcswitchHostOnWrite(recordWrite);
+  tx.send(code, CODE_BITS);
+  rcswitchHostOnWrite(0);
+  wave.back().duration = micros() - lastChange;
+  if (wave.front().duration == 0) {
+    wave.erase(wave.begin());
+  }
+  return wave;
+}
+
+/** The receiver's view of two overlapping carriers, b starting offset us into a */
+static std::vector<Pulse> interleave(const std::vector<Pulse> &a, const std::vector<Pulse> &b, unsigned long offset) {
+  // level change times of both signals, merged
+  std::vector<Pulse> out;
+  size_t ia = 0, ib = 0;
+  unsigned long ta = 0, tb = offset;
+  unsigned long now = 0;
+  bool la = false, lb = false;
+  while (ia < a.size() || ib < b.size()) {
+    const unsigned long nextA = (ia < a.size()) ? ta + a[ia].duration : ~0UL;
+    const unsigned long nextB = (ib < b.size()) ? tb + b[ib].duration : ~0UL;
+    // level until the next change of either signal
+    la = (ia < a.size()) && a[ia].high;
+    lb = (ib < b.size()) && now >= tb && b[ib].high;
+    const unsigned long next = (nextA < nextB) ? nextA : ((now < tb && tb < nextA) ? tb : nextB);
+    const bool level = la || lb;
+    if (next > now) {
+      if (!out.empty() && out.back().high == level) {
+        out.back().duration += next - now;
+      } else {
+        out.push_back(Pulse { level, (unsigned int)(next - now) });
+      }
+      now = next;
+    }
+    if (next == nextA) {
+      ta = nextA;
+      ia++;
+    }
+    if (next == nextB && now >= tb) {
+      tb = nextB;
+      ib++;
+    }
+  }
+  return out;
+}
+
+/** Applies jitter, glitches and dropped edges for the given noise level */
+static void degrade(std::vector<Pulse> &wave, int level) {
+  const double jitter = 0.05 * level;
+  const double glitchRate = 0.002 * level;
+  const double dropRate = 0.001 * level;
+
+  std::vector<Pulse> out;
+  for (size_t i = 0; i < wave.size(); i++) {
+    Pulse p = wave[i];
+    p.duration = (unsigned int)(p.duration * (1.0 + jitter * (2.0 * uniform() - 1.0)));
+    if (p.duration < 1) {
+      p.duration = 1;
+    }
+    if (uniform() < glitchRate && p.duration > 100) {
+      const unsigned int width = 10 + rng() % 50;
+      const unsigned int before = rng() % (p.duration - width);
+      out.push_back(Pulse { p.high, before });
+      out.push_back(Pulse { !p.high, width });
+      p.duration -= before + width;
+    }
+    if (!out.empty() && (out.back().high == p.high || uniform() < dropRate)) {
+      out.back().duration += p.duration;
+    } else {
+      out.push_back(p);
+    }
+  }
+  wave.swap(out);
+}
+
+static Segment segment(int protocol, int level, int nProtocols) {
+  Segment seg;
+  seg.codes[0] = rng() & ((1UL << CODE_BITS) - 1);
+  seg.nCodes = 1;
+  std::vector<Pulse> wave = transmission(protocol, seg.codes[0]);
+
+  if (uniform() < 0.1 * level) {
+    seg.codes[1] = rng() & ((1UL << CODE_BITS) - 1);
+    seg.nCodes = 2;
+    unsigned long length = 0;
+    for (size_t i = 0; i < wave.size(); i++) {
+      length += wave[i].duration;
+    }
+    const std::vector<Pulse> other = transmission(1 + rng() % nProtocols, seg.codes[1]);
+    wave = interleave(wave, other, rng() % length);
+  }
+  degrade(wave, level);
+
+  // idle line before, random noise after, idle again
+  seg.durations.push_back(50000);
+  for (size_t i = 0; i < wave.size(); i++) {
+    seg.durations.push_back(wave[i].duration);
+  }
+  const unsigned int noise = 20 * level;
+  for (unsigned int i = 0; i < noise; i++) {
+    seg.durations.push_back(100 + rng() % 3000);
+    if (rng() % 16 == 0) {
+      seg.durations.push_back(5000 + rng() % 10000);
+    }
+  }
+  seg.durations.push_back(50000);
+  return seg;
+}
+
+struct Result {
+  unsigned long transmissions;
+  unsigned long decoded;
+  unsigned long frames;
+  unsigned long falseFrames;
+  unsigned long edges;
+  double seconds;
+};
+
+static Result run(const std::vector<Segment> &segments, int tolerance) {
+  Result r = Result();
+  RCSwitch rx = RCSwitch();
+  rx.setReceiveTolerance(tolerance);
+  rx.setGlitchFilter(minPulse);
+  rx.setEdgeRateLimit(maxEdges, edgeWindow, maskTime);
+  rx.setSenderCalibration(calibrate);
+  rx.enableReceive(RX_INTERRUPT);
+
+  RCSwitch::ReceivedFrame frame;
+  for (size_t s = 0; s < segments.size(); s++) {
+    const Segment &seg = segments[s];
+    bool hit[2] = { false, false };
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < seg.durations.size(); i++) {
+      rcswitchHostEdge(RX_INTERRUPT, seg.durations[i]);
+    }
+    // lets the receiver lift a rate limit mask
+    rx.available();
+    r.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.edges += seg.durations.size();
+
+    while (rx.readFrame(frame)) {
+      r.frames++;
+      bool match = false;
+      for (unsigned int c = 0; c < seg.nCodes; c++) {
+        if (frame.value == seg.codes[c] && frame.bitlength == CODE_BITS) {
+          hit[c] = match = true;
+        }
+      }
+      if (!match) {
+        r.falseFrames++;
+      }
+    }
+    r.transmissions += seg.nCodes;
+    r.decoded += hit[0] + hit[1];
+  }
+  return r;
+}
+
+int main(int argc, char** argv) {
+  unsigned int perProtocol = 50;
+  int onlyProtocol = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      perProtocol = strtoul(argv[++i], 0, 10);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      rngState = strtoull(argv[++i], 0, 0) | 1;
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      onlyProtocol = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+      minPulse = strtoul(argv[++i], 0, 10);
+    } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc &&
+               sscanf(argv[++i], "%u:%lu:%lu", &maxEdges, &edgeWindow, &maskTime) == 3) {
+      // parsed above
+    } else if (strcmp(argv[i], "-c") == 0) {
+      calibrate = true;
+    } else {
+      fprintf(stderr, "usage: %s [-n transmissions per protocol] [-r seed] [-p protocol]\n"
+                      "          [-g min pulse us] [-e max edges:window us:mask us] [-c]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  const int nProtocols = RCSwitch::getProtocolCount();
+  std::vector<Segment> segments[NOISE_LEVELS];
+  for (int level = 0; level < NOISE_LEVELS; level++) {
+    for (int p = 1; p <= nProtocols; p++) {
+      if (onlyProtocol && p != onlyProtocol) {
+        continue;
+      }
+      for (unsigned int n = 0; n < perProtocol; n++) {
+        segments[level].push_back(segment(p, level, nProtocols));
+      }
+    }
+  }
+
+  printf("noise level: jitter +-5%%/level, 0.2%%/level glitches, 0.1%%/level dropped edges,\n"
+         "             10%%/level interleaved transmitters, 20 noise pulses/level\n\n");
+  printf("tolerance |");
+  for (int level = 0; level < NOISE_LEVELS; level++) {
+    printf("  noise %d: decode%% false%% ns/edge |", level);
+  }
+  printf("\n");
+  for (size_t t = 0; t < sizeof(tolerances) / sizeof(tolerances[0]); t++) {
+    printf("%8d%% |", tolerances[t]);
+    for (int level = 0; level < NOISE_LEVELS; level++) {
+      const Result r = run(segments[level], tolerances[t]);
+      printf("          %6.1f %6.1f %7.1f |",
+             100.0 * r.decoded / r.transmissions,
+             r.frames ? 100.0 * r.falseFrames / r.frames : 0.0,
+             1e9 * r.seconds / r.edges);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,295 @@
+/*
+  rfreplay - replays RF pulse traces through the RCSwitch receive path on a
+  desktop machine, to regression-test and benchmark the decoder.
+
+  A trace is a list of pulse durations in microseconds, each ending at a
+  level change, separated by whitespace or commas; '#' starts a comment.
+  The raw data of a received frame (getReceivedRawdata()) or a logic
+  analyzer export fits that format. Frames can also be synthesized with
+  -s, in which case they are produced by RCSwitch::send() itself, or by
+  RCSwitch::sendAsync() after -a.
+
+  With -r, the confirmed frames also go through the firmware's RfRatePolicy
+  (global rule as in the firmware), as they would before being published;
+  -e then turns the run into a check of how many get through. A held button
+  with a hold-to-repeat override, in low latency mode:
+
+    rfreplay -q -L -r 1:2000 -o 5592405:1:500 -e 9 -s 1:5592405:24:100
+
+  Usage: rfreplay [-q] [-d] [-L] [-a] [-t percent] [-l loops]
+                  [-r burst:ms [-o code:burst:ms]... [-e allowed]]
+                  [-s protocol:code:bits[:repeats]]... [trace file]...
+
+    -q  do not print every decoded frame
+    -d  use deferred decoding (decode from the "main loop")
+    -L  use low latency mode (decode on the first complete frame)
+    -a  synthesize the following transmissions asynchronously
+    -t  receive tolerance in percent (default 60)
+    -l  replay the whole trace this many times (default 1)
+    -r  per-code rate rule: burst events, then one more every ms
+    -o  rate rule for one code (hold-to-repeat override)
+    -e  exit with status 1 unless exactly this many frames are allowed
+    -s  append a synthesized transmission
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include <RCSwitch.h>
+#include "RfRatePolicy.h"
+
+#define RX_INTERRUPT 0
+#define TX_PIN 1
+
+// Idle time inserted around synthesized transmissions; well above the
+// receiver's separation limit and unlike any sync length
+#define SYNTH_SILENCE 100000
+
+// Global publish rule of the firmware (RF_PUBLISH_BURST/_INTERVAL_MS)
+#define RATE_GLOBAL_BURST 8
+#define RATE_GLOBAL_INTERVAL_MS 250
+
+static std::vector<unsigned int> trace;
+static int lastLevel = LOW;
+static unsigned long lastChange = 0;
+static bool async = false;
+
+static void recordWrite(int pin, int level, unsigned long time) {
+  if (pin != TX_PIN || level == lastLevel) {
+    return;
+  }
+  trace.push_back(time - lastChange);
+  lastLevel = level;
+  lastChange = time;
+}
+
+static bool synthesize(const char* spec) {
+  unsigned int protocol = 0, bits = 0, repeats = 10;
+  RCSwitch::Code code = 0;
+  // the code gets its own strtoull(): %lli would overflow from 2^63 up
+  char* end;
+  protocol = strtoul(spec, &end, 10);
+  bool ok = *end == ':';
+  if (ok) {
+    code = strtoull(end + 1, &end, 0);
+    ok = *end == ':' && sscanf(end + 1, "%u:%u", &bits, &repeats) >= 1;
+  }
+  if (!ok || bits == 0 || bits > RCSWITCH_MAX_BITS) {
+    fprintf(stderr, "bad synthesis spec '%s', expected protocol:code:bits[:repeats]\n", spec);
+    return false;
+  }
+
+  RCSwitch tx = RCSwitch();
+  tx.enableTransmit(TX_PIN);
+  tx.setProtocol(protocol);
+  tx.setRepeatTransmit(repeats);
+
+  lastLevel = LOW;
+  lastChange = micros();
+  rcswitchHostAdvance(SYNTH_SILENCE);
+  rcswitchHostOnWrite(recordWrite);
+  if (async) {
+    tx.sendAsync(code, bits);
+    // the main loop would go on with other work meanwhile
+    while (tx.isTransmitting()) {
+      rcswitchHostAdvance(1000);
+    }
+  } else {
+    tx.send(code, bits);
+  }
+  rcswitchHostOnWrite(0);
+  if (lastLevel != LOW) {
+    trace.push_back(micros() - lastChange);
+    lastChange = micros();
+  }
+  // the idle line after the transmission ends with the next edge
+  rcswitchHostAdvance(SYNTH_SILENCE);
+  trace.push_back(micros() - lastChange);
+  return true;
+}
+
+static bool load(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    char* hash = strchr(line, '#');
+    if (hash) {
+      *hash = '\0';
+    }
+    for (char* tok = strtok(line, " \t\r\n,"); tok; tok = strtok(0, " \t\r\n,")) {
+      char* end;
+      const unsigned long duration = strtoul(tok, &end, 10);
+      if (*end != '\0') {
+        fprintf(stderr, "%s: not a duration: '%s'\n", path, tok);
+        fclose(f);
+        return false;
+      }
+      trace.push_back(duration);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static bool parseRule(const char* spec, RfRateRule& rule) {
+  unsigned int burst = 0, intervalMs = 0;
+  if (sscanf(spec, "%u:%u", &burst, &intervalMs) != 2 || burst == 0 || burst > 255 ||
+      intervalMs == 0 || intervalMs > 65535) {
+    fprintf(stderr, "bad rate rule '%s', expected burst:ms\n", spec);
+    return false;
+  }
+  rule.burst = burst;
+  rule.intervalMs = intervalMs;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool quiet = false;
+  bool deferred = false;
+  bool lowLatency = false;
+  int tolerance = 60;
+  unsigned long loops = 1;
+  bool rated = false;
+  RfRateRule perCode = { 0, 0 };
+  std::vector<std::pair<unsigned long, RfRateRule> > overrides;
+  long expectAllowed = -1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-q") == 0) {
+      quiet = true;
+    } else if (strcmp(argv[i], "-d") == 0) {
+      deferred = true;
+    } else if (strcmp(argv[i], "-L") == 0) {
+      lowLatency = true;
+    } else if (strcmp(argv[i], "-a") == 0) {
+      async = true;
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      tolerance = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      loops = strtoul(argv[++i], 0, 10);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      if (!parseRule(argv[++i], perCode)) {
+        return 2;
+      }
+      rated = true;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      char* end;
+      RfRateRule rule;
+      const unsigned long code = strtoul(argv[++i], &end, 0);
+      if (*end != ':' || !parseRule(end + 1, rule)) {
+        fprintf(stderr, "bad override '%s', expected code:burst:ms\n", argv[i]);
+        return 2;
+      }
+      overrides.push_back(std::make_pair(code, rule));
+    } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+      expectAllowed = strtol(argv[++i], 0, 10);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      if (!synthesize(argv[++i])) {
+        return 2;
+      }
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "usage: %s [-q] [-d] [-L] [-a] [-t percent] [-l loops] [-r burst:ms [-o code:burst:ms]... [-e allowed]] [-s protocol:code:bits[:repeats]]... [trace file]...\n", argv[0]);
+      return 2;
+    } else if (!load(argv[i])) {
+      return 2;
+    }
+  }
+  if (trace.empty()) {
+    fprintf(stderr, "nothing to replay\n");
+    return 2;
+  }
+  if (!rated && (!overrides.empty() || expectAllowed >= 0)) {
+    fprintf(stderr, "-o and -e need a rate rule (-r)\n");
+    return 2;
+  }
+
+  RfRatePolicy policy(perCode, { RATE_GLOBAL_BURST, RATE_GLOBAL_INTERVAL_MS });
+  for (size_t i = 0; i < overrides.size(); i++) {
+    if (!policy.setOverride(overrides[i].first, overrides[i].second)) {
+      fprintf(stderr, "override for %lu rejected\n", overrides[i].first);
+      return 2;
+    }
+  }
+  unsigned long allowed = 0;
+
+  RCSwitch rx = RCSwitch();
+  rx.setReceiveTolerance(tolerance);
+  rx.setDeferredDecoding(deferred);
+  rx.setLowLatency(lowLatency);
+  rx.enableReceive(RX_INTERRUPT);
+
+  unsigned long frames = 0;
+  unsigned long perProtocol[RCSWITCH_MAX_PROTOCOLS + 1] = { 0 };
+  unsigned long long signalMicros = 0;
+  RCSwitch::ReceivedFrame frame;
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long loop = 0; loop < loops; loop++) {
+    for (size_t i = 0; i < trace.size(); i++) {
+      rcswitchHostEdge(RX_INTERRUPT, trace[i]);
+      signalMicros += trace[i];
+      // drain like a main loop would, often enough never to overflow
+      if (deferred || rx.getPendingFrames() >= RCSWITCH_RX_QUEUE_SIZE / 2 || i + 1 == trace.size()) {
+        while (rx.readFrame(frame)) {
+          frames++;
+          if (frame.protocol <= RCSWITCH_MAX_PROTOCOLS) {
+            perProtocol[frame.protocol]++;
+          }
+          // the firmware publishes only confirmed frames, so only those are rated
+          const char* verdict = "";
+          if (rated && (frame.flags & RCSWITCH_FRAME_CONFIRMED)) {
+            switch (policy.check((unsigned long)frame.value, frame.timestamp / 1000)) {
+              case RfRatePolicy::ALLOW:
+                allowed++;
+                verdict = "  allowed";
+                break;
+              case RfRatePolicy::CODE_LIMITED:
+                verdict = "  code limited";
+                break;
+              case RfRatePolicy::GLOBAL_LIMITED:
+                // queued by the firmware and published paced
+                allowed++;
+                verdict = "  global limited, queued";
+                break;
+            }
+          }
+          if (!quiet) {
+            printf("%10lu us  %llu / %u bit  protocol %u  delay %u%s%s%s%s\n", frame.timestamp,
+                   (unsigned long long)frame.value, frame.bitlength, frame.protocol, frame.delay,
+                   (frame.flags & RCSWITCH_FRAME_REPEAT) ? "  repeat" : "",
+                   (frame.flags & RCSWITCH_FRAME_CONFIRMED) ? "  confirmed" : "",
+                   (frame.flags & RCSWITCH_FRAME_CANCELLED) ? "  cancelled" : "", verdict);
+          }
+        }
+      }
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("protocol  frames\n");
+  for (unsigned int p = 1; p <= RCSWITCH_MAX_PROTOCOLS; p++) {
+    if (perProtocol[p]) {
+      printf("%8u  %lu\n", p, perProtocol[p]);
+    }
+  }
+  printf("edges %lu, frames %lu, dropped %u (queue) %u (capture)\n",
+         (unsigned long)(trace.size() * loops), frames, rx.getOverflowCount(), rx.getCaptureOverrunCount());
+  printf("%.6f s wall, %.0f frames/s, %.0f edges/s, %.0fx real time\n", seconds,
+         frames / seconds, trace.size() * loops / seconds, signalMicros / 1e6 / seconds);
+  if (rated) {
+    printf("rate policy: allowed %lu (global limited %lu of them), code limited %lu\n", allowed,
+           policy.globalLimitedCount(), policy.codeLimitedCount());
+    if (expectAllowed >= 0 && allowed != (unsigned long)expectAllowed) {
+      fprintf(stderr, "expected %ld allowed frames, got %lu\n", expectAllowed, allowed);
+      return 1;
+    }
+  }
+  return 0;
+}